@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "my_malloc.h"
+
+/* Measures how allocator throughput scales with the number of threads.
+ * Each thread keeps LIVE blocks of 16 to 256 bytes alive at a time and
+ * does OPS random frees and mallocs on them. The same work is run with 1
+ * thread, then 2, and so on up to the thread count given on the command
+ * line (the number of online cores by default), reporting operations per
+ * second and the speedup over a single thread. A second argument sets
+ * how many arenas the threads are spread over (see ARENA_COUNT).
+ * After that two threads play ping-pong: each allocates a message, hands
+ * it to the other through a mailbox and frees the one it gets back, so
+ * every block is freed by a thread other than the one that allocated it.
+ * Last, every policy replays the same trace of TRACE_OPS random mallocs
+ * and frees of 16 to 1024 bytes, with up to TRACE_LIVE blocks alive, on a
+ * heap of its own. Each reports operations per second, the most address
+ * space its blocks ever spanned, and fragmentation: how much of that span
+ * was not live data at the peak of live data.
+ * Then size order, and address order if it walks its freelist too, get a
+ * heap with FIT_FREE free blocks that cannot merge, and time a malloc and
+ * free of a random size on it FIT_OPS times. Comparing a build with
+ * -DFREE_INDEX against one without shows what the index saves on fit
+ * searches and on placing frees over thousands of free blocks, and one
+ * with -DSIDE_METADATA what the walk saves when the sizes and links it
+ * follows are packed in a table instead of spread over the heap.
+ * Built with -DTHREAD_SAFE by the bench target of the Makefile.
+ */
+
+#define OPS 200000
+#define LIVE 64
+#define ROUNDS 200000
+#define TRACE_OPS 200000
+#define TRACE_LIVE 1000
+#define TRACE_HEAP ((size_t) 64 << 20)
+#define FIT_FREE 4000
+#define FIT_OPS 20000
+
+#ifdef BOUNDARY_TAGS
+#define BENCH_MALLOC my_malloc_tlsf
+#define BENCH_FREE my_free_tlsf
+#define BENCH_NAME "tlsf"
+#else
+#define BENCH_MALLOC my_malloc_size_order
+#define BENCH_FREE my_free_size_order
+#define BENCH_NAME "size order"
+#endif
+
+#ifdef SIDE_METADATA
+#define BENCH_LAYOUT ", side metadata"
+#else
+#define BENCH_LAYOUT ""
+#endif
+
+void* churn(void* arg) {
+	unsigned int seed = (unsigned int) (uintptr_t) arg;
+	void* blocks[LIVE] = {NULL};
+	for (int i = 0; i < OPS; i++) {
+		int slot = rand_r(&seed) % LIVE;
+		if (blocks[slot] != NULL) {
+			BENCH_FREE(blocks[slot]);
+			blocks[slot] = NULL;
+		} else {
+			blocks[slot] = BENCH_MALLOC(16 + rand_r(&seed) % 241);
+		}
+	}
+	for (int slot = 0; slot < LIVE; slot++) {
+		BENCH_FREE(blocks[slot]);
+	}
+	return NULL;
+}
+
+double run(int nthreads) {
+	pthread_t threads[nthreads];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, churn, (void*) (uintptr_t) (i + 1));
+	}
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return (double) OPS * nthreads / seconds;
+}
+
+/* mailboxes[i] holds the message waiting for player i, if any */
+void* mailboxes[2];
+
+void* play(void* arg) {
+	int me = (int) (uintptr_t) arg;
+	if (me == 0) {
+		__atomic_store_n(&mailboxes[1], BENCH_MALLOC(64), __ATOMIC_RELEASE);
+	}
+	for (int i = 0; i < ROUNDS; i++) {
+		void* msg;
+		while ((msg = __atomic_exchange_n(&mailboxes[me], NULL, __ATOMIC_ACQUIRE)) == NULL) {
+			sched_yield();
+		}
+		BENCH_FREE(msg);
+		if (me == 1 || i + 1 < ROUNDS) {
+			__atomic_store_n(&mailboxes[!me], BENCH_MALLOC(64), __ATOMIC_RELEASE);
+		}
+	}
+	return NULL;
+}
+
+double pingPong() {
+	pthread_t players[2];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < 2; i++) {
+		pthread_create(&players[i], NULL, play, (void*) (uintptr_t) i);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_join(players[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return ROUNDS / seconds;
+}
+
+/* trace[i] is the slot the i-th operation works on, and sizes[i] the size
+to allocate if that slot is empty */
+int trace[TRACE_OPS];
+size_t sizes[TRACE_OPS];
+
+void makeTrace() {
+	unsigned int seed = 1;
+	for (int i = 0; i < TRACE_OPS; i++) {
+		trace[i] = rand_r(&seed) % TRACE_LIVE;
+		sizes[i] = 16 + rand_r(&seed) % 1009;
+	}
+}
+
+void replay(enum ORDER order, const char* name) {
+	my_heap_t* heap = my_heap_create(NULL, TRACE_HEAP, order);
+	char* blocks[TRACE_LIVE] = {NULL};
+	size_t live[TRACE_LIVE] = {0};
+	size_t liveBytes = 0, peakLive = 0, peakSpan = 0;
+	char* low = NULL;
+	char* high = NULL;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < TRACE_OPS; i++) {
+		int slot = trace[i];
+		if (blocks[slot] != NULL) {
+			my_heap_free(heap, blocks[slot]);
+			blocks[slot] = NULL;
+			liveBytes -= live[slot];
+			continue;
+		}
+		blocks[slot] = (char*) my_heap_malloc(heap, sizes[i]);
+		live[slot] = sizes[i];
+		liveBytes += sizes[i];
+		if (low == NULL || blocks[slot] < low) {
+			low = blocks[slot];
+		}
+		if (blocks[slot] + sizes[i] > high) {
+			high = blocks[slot] + sizes[i];
+		}
+		if (liveBytes > peakLive) {
+			peakLive = liveBytes;
+			peakSpan = high - low;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-12s %-12.0f %-10zu %.1f%%\n", name, TRACE_OPS / seconds, (size_t) (high - low) / 1024,
+	       100.0 * (1 - (double) peakLive / peakSpan));
+	my_heap_destroy(heap);
+}
+
+void fitSearch(enum ORDER order, const char* name) {
+	my_heap_t* heap = my_heap_create(NULL, TRACE_HEAP, order);
+	unsigned int seed = 1;
+	/* Every free block is kept apart from the next by one in use. */
+	void* freed[FIT_FREE];
+	for (int i = 0; i < FIT_FREE; i++) {
+		freed[i] = my_heap_malloc(heap, 16 + rand_r(&seed) % 1009);
+		my_heap_malloc(heap, 1);
+	}
+	for (int i = 0; i < FIT_FREE; i++) {
+		my_heap_free(heap, freed[i]);
+	}
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < FIT_OPS; i++) {
+		my_heap_free(heap, my_heap_malloc(heap, 16 + rand_r(&seed) % 1009));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-12s %.0f\n", name, FIT_OPS / seconds);
+	my_heap_destroy(heap);
+}
+
+int main(int argc, char** argv) {
+	int maxThreads = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxThreads < 1) {
+		maxThreads = 1;
+	}
+	/* the emulated heap is far too small for this many live blocks */
+	my_sbrk_init(SBRK_RESERVED, 0);
+	if (argc > 2 && !my_mallopt(ARENA_COUNT, atoi(argv[2]))) {
+		fprintf(stderr, "arena count must be from 1 to %d\n", MAX_ARENAS);
+		return 1;
+	}
+	printf("%s%s, %d ops per thread, %d live blocks per thread\n", BENCH_NAME, BENCH_LAYOUT, OPS, LIVE);
+	printf("threads  ops/sec      speedup\n");
+	double single = 0;
+	for (int n = 1; n <= maxThreads; n++) {
+		double rate = run(n);
+		if (n == 1) {
+			single = rate;
+		}
+		printf("%-8d %-12.0f %.2f\n", n, rate, rate / single);
+	}
+	printf("ping-pong: %.0f round trips/sec\n", pingPong());
+	makeTrace();
+	printf("%d op trace, up to %d live blocks of 16 to 1024 bytes\n", TRACE_OPS, TRACE_LIVE);
+	printf("policy       ops/sec      span (KB)  fragmentation\n");
+	replay(SIZE, "size order");
+	replay(ADDRESS, "addr order");
+	replay(NEXT_FIT, "next fit");
+	replay(GOOD_FIT, "good fit");
+#ifdef BOUNDARY_TAGS
+	replay(SEGREGATED, "segregated");
+	replay(TLSF, "tlsf");
+#endif
+#ifdef FREE_INDEX
+	printf("malloc and free pairs/sec with %d free blocks, free size index%s\n", FIT_FREE, BENCH_LAYOUT);
+#else
+	printf("malloc and free pairs/sec with %d free blocks, freelist walk%s\n", FIT_FREE, BENCH_LAYOUT);
+#endif
+	fitSearch(SIZE, "size order");
+#ifndef BOUNDARY_TAGS
+	fitSearch(ADDRESS, "addr order");
+#endif
+	return 0;
+}
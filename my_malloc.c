@@ -1,4 +1,11 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "my_malloc.h"
+#if defined(FREE_INDEX) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 /* You *MUST* use this macro when calling my_sbrk to allocate the
  * appropriate size. Failure to do so may result in an incorrect
@@ -28,39 +35,499 @@
  */
 metadata_t* freelist;
 
-enum ORDER sortBy;
+THREAD_LOCAL enum my_malloc_err ERRNO;
 
-void* my_malloc_size_order(size_t size)
-{
-    sortBy = SIZE;
+/* With -DTHREAD_SAFE, an arena's lock is held around everything that
+ * touches its heap: the freelist and the bins or trees built on it, the
+ * block metadata, and its break. Large blocks live in mappings of their
+ * own and are mapped and unmapped outside it. Without it, LOCK_HEAP and
+ * UNLOCK_HEAP do nothing.
+ * A free that finds the lock taken does not wait for it. The block goes
+ * on the arena's remoteFrees instead, a stack linked through next that
+ * any thread can push onto with a compare and swap, and whoever holds the
+ * lock next takes the whole stack at once and frees it. Blocks waiting
+ * there still look in use to the heap.
+ */
+#ifdef THREAD_SAFE
+#define LOCK_HEAP() pthread_mutex_lock(&arena->lock)
+#define UNLOCK_HEAP() pthread_mutex_unlock(&arena->lock)
+#else
+#define LOCK_HEAP()
+#define UNLOCK_HEAP()
+#endif
+
+/* With -DBOUNDARY_TAGS, every block ends in a footer_t, so each block
+ * costs its metadata plus the footer, and its size is kept a multiple of
+ * BLOCK_ALIGN so that every header stays pointer aligned. Without it, a
+ * block is just its metadata followed by the user's memory, same as always.
+ * With -DCOMPACT_HEADER, a block in use costs just its head word, and
+ * its size is kept a multiple of BLOCK_ALIGN to leave room for the flags.
+ * With -DSIDE_METADATA, a block costs nothing in the heap, but it is a
+ * whole number of SIDE_GRANULE cache lines and starts on one.
+ * MIN_BLOCK_SIZE is the smallest a block can be and still hold everything
+ * it needs once it is free.
+ */
+#if defined(BOUNDARY_TAGS) && !defined(COMPACT_HEADER)
+#define FOOTER_SIZE sizeof(footer_t)
+#else
+#define FOOTER_SIZE 0
+#endif
+#define BLOCK_OVERHEAD (HEADER_SIZE + FOOTER_SIZE)
+#ifdef COMPACT_HEADER
+#define BLOCK_ALIGN 8
+#define MIN_BLOCK_SIZE (sizeof(metadata_t) + sizeof(footer_t))
+#elif defined(BOUNDARY_TAGS)
+#define BLOCK_ALIGN 8
+#define MIN_BLOCK_SIZE ROUND_UP(BLOCK_OVERHEAD, BLOCK_ALIGN)
+#elif defined(SIDE_METADATA)
+#define BLOCK_ALIGN SIDE_GRANULE
+#define MIN_BLOCK_SIZE SIDE_GRANULE
+#else
+#define BLOCK_ALIGN 1
+#define MIN_BLOCK_SIZE BLOCK_OVERHEAD
+#endif
+
+/* The largest a block can be, which for the short sizes in metadata_t is
+ * well short of what a reserved heap can hold. Free neighbors are only
+ * merged when the result still fits. Leaving two free blocks side by side
+ * is fine for every layout where it can happen, since they only look at
+ * their neighbors' in_use and never assume the neighbors were merged.
+ */
+#ifdef COMPACT_HEADER
+#define MAX_BLOCK_SIZE (SIZE_MAX & ~FLAG_BITS)
+#elif defined(SIDE_METADATA)
+#define MAX_BLOCK_SIZE ((size_t) UINT_MAX & ~((size_t) SIDE_GRANULE - 1))
+#else
+#define MAX_BLOCK_SIZE ((size_t) SHRT_MAX)
+#endif
+#define CAN_MERGE(a, b) ((size_t) GET_SIZE(a) + GET_SIZE(b) <= MAX_BLOCK_SIZE)
+
+/* With -DSIDE_METADATA, every heap keeps its blocks' metadata in a side
+ * table apart from it: sideTable[i] is the metadata of the block that
+ * starts at sideBase + i * SIDE_GRANULE, if one does. Sizes, flags and
+ * the freelist links are then all read from a few dense cache lines of
+ * the table, and the heap itself holds nothing but the user's memory.
+ * A heap block's metadata_t* is its table entry, so entries are in the
+ * same order as the blocks, and the block n bytes on from blk is just
+ * n / SIDE_GRANULE entries on.
+ * BLOCK_MEM and BLOCK_AT go between a heap block's metadata and where it
+ * starts in the current arena's heap, BLOCK_AFTER steps n bytes past a
+ * block, and USER_PTR and HEAP_HEADER go between a heap block and the
+ * user's memory. HEADER_OF does the same for memory that may be in any
+ * arena's heap or mapped on its own. Without SIDE_METADATA, all of these
+ * are plain pointer arithmetic.
+ */
+#ifdef SIDE_METADATA
+#define BLOCK_MEM(blk) (arena->sideBase + (size_t) ((blk) - arena->sideTable) * SIDE_GRANULE)
+#define BLOCK_AT(mem) (arena->sideTable + ((char*) (mem) - arena->sideBase) / SIDE_GRANULE)
+#define BLOCK_AFTER(blk, n) ((blk) + (n) / SIDE_GRANULE)
+#define HEADER_OF(ptr) findSideEntry(ptr)
+#else
+#define BLOCK_MEM(blk) ((char*) (blk))
+#define BLOCK_AT(mem) ((metadata_t*) (mem))
+#define BLOCK_AFTER(blk, n) ((metadata_t*) (((char*) (blk)) + (n)))
+#define HEADER_OF(ptr) HEAP_HEADER(ptr)
+#endif
+#define USER_PTR(blk) (BLOCK_MEM(blk) + HEADER_SIZE)
+#define HEAP_HEADER(ptr) BLOCK_AT((char*) (ptr) - HEADER_SIZE)
+
+#ifdef BOUNDARY_TAGS
+/* One past the last byte my_sbrk has given us. Every stretch of heap we
+ * own is bracketed by fence posts: an in-use footer at the very start and
+ * an in-use header stub (a footer at the front of BLOCK_ALIGN bytes) at the
+ * very end. That way the left and right neighbor lookups never have to
+ * bounds check, they just see an in-use block and stop. The start fence
+ * is padded out to HEAP_ALIGN with its footer in the last bytes, so the
+ * first block starts as aligned as the heap does.
+ * The compact header needs no start fence, since the first block just has
+ * PINUSE set, and its end fence is a whole head word.
+ */
+#ifdef COMPACT_HEADER
+#define START_FENCE_SIZE 0
+#define END_FENCE_SIZE sizeof(size_t)
+#else
+#define START_FENCE_SIZE HEAP_ALIGN
+#define END_FENCE_SIZE BLOCK_ALIGN
+#endif
+
+/* Segregated free lists used by my_malloc_segregated. Blocks smaller than
+ * SMALL_BIN_LIMIT get an exact bin per BIN_STEP bytes of size, everything
+ * bigger goes into one bin per power of two.
+ */
+#define BIN_STEP 8
+#define SMALL_BIN_LIMIT_LOG 9
+#define SMALL_BIN_LIMIT (1 << SMALL_BIN_LIMIT_LOG)
+#define SMALL_BIN_COUNT (SMALL_BIN_LIMIT / BIN_STEP)
+#define LARGE_BIN_COUNT 32
+#define NUM_BINS (SMALL_BIN_COUNT + LARGE_BIN_COUNT)
+
+/* Two level segregated fit lists used by my_malloc_tlsf. The first level
+ * splits sizes by power of two and the second level splits each power of
+ * two into TLSF_SL_COUNT equal slices. A set bit in tlsfFlBitmap means that
+ * first level has a non-empty list somewhere, and a set bit in
+ * tlsfSlBitmap[fl] means that exact list is non-empty.
+ */
+#define TLSF_SL_LOG 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG)
+#define TLSF_SMALL_LIMIT_LOG 7
+#define TLSF_SMALL_LIMIT (1 << TLSF_SMALL_LIMIT_LOG)
+#define TLSF_FL_COUNT 32
+
+/* Balanced trees used by my_malloc_addr_order. Each free block is in both:
+ * addrRoot is ordered by address and keeps freelist in address order
+ * without walking it, sizeRoot is ordered by size, then address, and finds
+ * the best fit. Blocks too small to hold a treenode_t after their metadata
+ * only go on the freelist, which only happens when blocks allocated by
+ * another policy are freed here.
+ */
+#define ADDR_TREE 0
+#define SIZE_TREE 1
+#define TREE_MIN_SIZE (MIN_BLOCK_SIZE + sizeof(treenode_t))
+#define TREE_NODE(blk) ((treenode_t*) (((char*) (blk)) + sizeof(metadata_t)))
+#endif
+
+/* The smallest piece that can be cut off a block and freed in the given
+ * order. The orders that keep their free blocks in the trees never cut
+ * off anything the trees could not hold.
+ */
+#ifdef BOUNDARY_TAGS
+#define SPLIT_MIN(order) (ADDRESS_ORDERED(order) ? TREE_MIN_SIZE : MIN_BLOCK_SIZE)
+#else
+#define SPLIT_MIN(order) MIN_BLOCK_SIZE
+#endif
+
+/* The heap grows by at least as much as a request needs, in whole
+ * SBRK_SIZE steps. With GROW_FIXED that is rounded up to a multiple of
+ * growChunk, with GROW_GEOMETRIC the heap grows by at least heapSize, the
+ * size it already is. No single step is bigger than MAX_GROW, which is as
+ * much as my_sbrk can take at once and as big as a block can get.
+ * Without boundary tags there are no fences, the last block runs right up
+ * to the break.
+ */
+#ifndef BOUNDARY_TAGS
+#define START_FENCE_SIZE 0
+#define END_FENCE_SIZE 0
+#endif
+/* The most extendHeap and addToFreeList write past where the heap grew
+ * from: a start fence post, then a free block's metadata and, for the
+ * address ordered trees, its tree node. With side metadata, nothing.
+ */
+#ifdef BOUNDARY_TAGS
+#define GROWTH_BOOKKEEPING (START_FENCE_SIZE + sizeof(metadata_t) + sizeof(treenode_t))
+#elif defined(SIDE_METADATA)
+#define GROWTH_BOOKKEEPING 0
+#else
+#define GROWTH_BOOKKEEPING sizeof(metadata_t)
+#endif
+#define ROUND_UP(n, step) (((n) + (step) - 1) / (step) * (step))
+#define MAX_GROW ((MAX_BLOCK_SIZE < INT_MAX ? MAX_BLOCK_SIZE : INT_MAX) / SBRK_SIZE * SBRK_SIZE)
+static enum GROW growPolicy = GROW_FIXED;
+static size_t growChunk = SBRK_SIZE;
+
+/* Requests over mmapThreshold bytes skip the heap and get a mapping of
+ * their own, which starts with its length followed by the block's
+ * metadata. With side metadata those two are still in the mapping, as
+ * there is no table for them to go in, padded so that they end on a
+ * cache line. By default that is anything that does not fit in one
+ * SBRK_SIZE chunk. MAX_HEAP_REQUEST is the most the heap can hand out in
+ * one block, so the threshold can never be set higher than that.
+ */
+#define MAX_HEAP_REQUEST (MAX_GROW - START_FENCE_SIZE - END_FENCE_SIZE - BLOCK_OVERHEAD)
+#define DEFAULT_MMAP_THRESHOLD (SBRK_SIZE - BLOCK_OVERHEAD)
+#ifdef SIDE_METADATA
+#define MAPPED_HEADER_SIZE sizeof(metadata_t)
+#else
+#define MAPPED_HEADER_SIZE HEADER_SIZE
+#endif
+#define LARGE_OVERHEAD ROUND_UP(sizeof(size_t) + MAPPED_HEADER_SIZE, BLOCK_ALIGN)
+static size_t mmapThreshold = DEFAULT_MMAP_THRESHOLD;
+
+/* When freeing leaves a free block of more than trimThreshold bytes
+ * running up to the break, all but the start of it goes back to my_sbrk.
+ * The heap only ever shrinks in whole SBRK_SIZE steps, the same way it
+ * grows. Without boundary tags there is no end fence, the last block runs
+ * right up to the break.
+ */
+#define DEFAULT_TRIM_THRESHOLD (128 * 1024)
+static size_t trimThreshold = DEFAULT_TRIM_THRESHOLD;
+
+/* Blocks freed for requests of at most fastbinMax bytes skip coalescing
+ * and go on the fast list for their size in the arena, LIFO and linked
+ * through next, to be handed straight back out to the next request that
+ * fits. Class i holds blocks of i * FASTBIN_STEP up to
+ * (i + 1) * FASTBIN_STEP bytes, metadata included. Like cached blocks they
+ * still look in use, so nothing merges with them until a consolidation
+ * frees them all for real. That happens when nothing free in the heap
+ * fits a request and the heap would otherwise have to grow, when an arena
+ * has FASTBIN_CONSOLIDATE blocks on its lists, and on my_malloc_trim.
+ * Off (0) by default.
+ */
+#define FASTBIN_STEP 8
+#define FASTBIN_MAX_REQUEST 160
+#define FASTBIN_CLASSES ((FASTBIN_MAX_REQUEST + BLOCK_OVERHEAD + BLOCK_ALIGN - 1) / FASTBIN_STEP + 2)
+#define FASTBIN_CONSOLIDATE 64
+static size_t fastbinMax;
+
+/* NEXT_FIT and GOOD_FIT keep the same address ordered free structures as
+ * ADDRESS and only search them differently. Next fit walks the freelist
+ * from rover, the block its last search stopped at, wrapping around to
+ * the start once. Good fit walks from the start and takes the first block
+ * that fits with at most goodFitSlack percent to spare, or else the
+ * smallest of the first goodFitCount blocks that fit at all.
+ */
+#define ADDRESS_ORDERED(order) ((order) == ADDRESS || (order) == NEXT_FIT || (order) == GOOD_FIT)
+#define DEFAULT_GOOD_FIT_COUNT 8
+#define DEFAULT_GOOD_FIT_SLACK 25
+static size_t goodFitCount = DEFAULT_GOOD_FIT_COUNT;
+static size_t goodFitSlack = DEFAULT_GOOD_FIT_SLACK;
+
+/* With -DTHREAD_CACHE, every thread keeps up to tcacheCount freed blocks
+ * of each small size class for itself, linked through next, and hands
+ * them back out without taking any lock. Class i holds blocks of
+ * i * TCACHE_STEP up to (i + 1) * TCACHE_STEP bytes, metadata included.
+ * Cached blocks still look in use to the heap, so nothing merges with
+ * them. A thread's cache goes back to the heap when the thread exits,
+ * through the destructor of tcacheKey.
+ */
+#ifdef THREAD_CACHE
+#define TCACHE_STEP 16
+#define TCACHE_CLASSES 32
+#define TCACHE_MAX_SIZE (TCACHE_STEP * TCACHE_CLASSES)
+#define DEFAULT_TCACHE_COUNT 16
+static size_t tcacheCount = DEFAULT_TCACHE_COUNT;
+static __thread metadata_t* tcache[TCACHE_CLASSES];
+static __thread size_t tcacheLen[TCACHE_CLASSES];
+static __thread int tcacheRegistered;
+static pthread_key_t tcacheKey;
+static pthread_once_t tcacheOnce = PTHREAD_ONCE_INIT;
+#endif
+
+/* With -DSLAB, requests of at most slabThreshold bytes come out of slabs
+ * instead of the heap. A slab is one SLAB_SIZE page split into equal
+ * slots of one size class, a multiple of SLAB_STEP, after a slab_t that
+ * tracks them. Slots carry no metadata at all; free slots are linked
+ * through their first word on freeSlots, and slots never handed out yet
+ * start at fresh. Every arena keeps a list per class of its slabs that
+ * still have a slot to give. Slab pages come from slabPool, one
+ * SLAB_POOL_SIZE mapping made the first time a slab is needed, so that
+ * the free functions can tell a slot from a heap block by its address
+ * and find its slab by rounding down to SLAB_SIZE. Slabs that empty out
+ * go back on freeSlabs for any arena to reuse, unless they are the last
+ * one their class has.
+ */
+#ifdef SLAB
+#define SLAB_SIZE 4096
+#define SLAB_STEP 8
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASSES (SLAB_MAX_SIZE / SLAB_STEP)
+#define SLAB_POOL_SIZE ((size_t) 64 << 20)
+#define SLAB_HEADER ROUND_UP(sizeof(slab_t), 16)
+static size_t slabThreshold = SLAB_MAX_SIZE;
+static char* slabPool;
+static size_t slabPoolTop;
+static slab_t* freeSlabs;
+#ifdef THREAD_SAFE
+static pthread_mutex_t slabPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t slabOnce = PTHREAD_ONCE_INIT;
+#endif
+#endif
+
+/* With -DFREE_INDEX, every block on the freelist of an order that walks
+ * it for a best fit (size order, and address order without boundary
+ * tags, which has no trees) also has its size in idxSizes and its address
+ * at the same place in idxBlocks. A fit search then scans the packed
+ * sizes, eight or four at a time with AVX2 or SSE2 when the compiler has
+ * them, instead of following next through headers all over the heap.
+ * Frees use it the same way to find where a block goes in the list, so
+ * that only its new neighbors' headers are read (see findListPlace).
+ * Blocks of one size are kept in the order the walk meets them, so ties
+ * go to the same block the walk would stop at. Size order appends, since
+ * a free block goes after the others of its size in the list. Address
+ * order keeps the whole index sorted by address, so a binary search finds
+ * where a block is or goes. Taking a block out closes the gap behind it
+ * so that neither order is lost.
+ * Sizes past INT32_MAX are kept as INT32_MAX, which no request can be
+ * over. The two arrays share one mapping from my_mmap that doubles when
+ * it fills. Should that fail, the arena's index is dropped for good and
+ * its searches go back to walking the freelist.
+ */
+#ifdef FREE_INDEX
+#ifdef BOUNDARY_TAGS
+#define INDEXED(order) ((order) == SIZE)
+#else
+#define INDEXED(order) ((order) == SIZE || (order) == ADDRESS)
+#endif
+#define INDEX_START 1024
+#define INDEX_ENTRY (sizeof(uint32_t) + sizeof(metadata_t*))
+#define INDEX_SIZE(blk) ((uint32_t) ((size_t) GET_SIZE(blk) < INT32_MAX ? (size_t) GET_SIZE(blk) : INT32_MAX))
+#endif
+
+/* ARENAS
+ * Everything that belongs to one heap lives in an arena_t: its free
+ * structures, how they are ordered, where its heap ends and how big it
+ * is, and with THREAD_SAFE its lock and remote free list. Arena i grows
+ * its own heap with my_sbrk_arena(i, ...), arena 0's being the one
+ * my_sbrk has always handed out, so a block belongs to whichever arena's
+ * heap it sits in.
+ * The code works on the arena that arena points at. The names defined
+ * below stand for that arena's fields, so it reads the same as when there
+ * was only one heap. freelist itself stays a real global, as the
+ * autograder expects, and is where arena 0 keeps its list.
+ * With THREAD_SAFE, each thread gets a home arena the first time it
+ * allocates, handed out round-robin over the first arenaCount arenas.
+ * Without it there is only ever arena 0.
+ * A heap handle from my_heap_create is an arena too, kept at the start of
+ * the region it was given and with an index of -1. Its break is a bump
+ * over the rest of that region instead of a my_sbrk_arena heap, and
+ * arenaSbrk is what moves either kind. Its bookkeeping starts HEAP_ALIGN
+ * aligned and so does its heap.
+ * With SIDE_METADATA, every arena and heap handle maps its side table
+ * the first time its heap grows (see mapSideTable).
+ */
+#define HEAP_ALIGN 16
+typedef struct arena {
+    metadata_t** head;
+    metadata_t* list;
+    enum ORDER sortBy;
+    size_t heapSize;
+#ifdef BOUNDARY_TAGS
+    char* heapEnd;
+    metadata_t* bins[NUM_BINS];
+    metadata_t* tlsfLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    unsigned int tlsfFlBitmap;
+    unsigned int tlsfSlBitmap[TLSF_FL_COUNT];
+    metadata_t* addrRoot;
+    metadata_t* sizeRoot;
+#endif
+#ifdef THREAD_SAFE
+    pthread_mutex_t lock;
+    metadata_t* remoteFrees;
+#endif
+#ifdef SLAB
+    slab_t* slabs[SLAB_CLASSES];
+#endif
+    metadata_t* fastbins[FASTBIN_CLASSES];
+    size_t fastCount;
+    metadata_t* rover;
+#ifdef FREE_INDEX
+    uint32_t* idxSizes;
+    metadata_t** idxBlocks;
+    size_t idxLen;
+    size_t idxCap;
+    int idxBroken;
+#endif
+#ifdef SIDE_METADATA
+    metadata_t* sideTable;
+    char* sideBase;
+    size_t sideLen;
+#endif
+    int index;
+    char* region;
+    size_t regionSize;
+    size_t regionTop;
+    size_t mapped;
+} arena_t;
+
+static arena_t arenas[MAX_ARENAS] = { { &freelist } };
+static THREAD_LOCAL arena_t* arena = &arenas[0];
+#ifdef THREAD_SAFE
+static size_t arenaCount;
+static unsigned int nextArena;
+static pthread_once_t arenaOnce = PTHREAD_ONCE_INIT;
+static __thread arena_t* homeArena;
+#endif
 
+#define freelist (*arena->head)
+#define sortBy (arena->sortBy)
+#define heapSize (arena->heapSize)
+#define heapEnd (arena->heapEnd)
+#define bins (arena->bins)
+#define tlsfLists (arena->tlsfLists)
+#define tlsfFlBitmap (arena->tlsfFlBitmap)
+#define tlsfSlBitmap (arena->tlsfSlBitmap)
+#define addrRoot (arena->addrRoot)
+#define sizeRoot (arena->sizeRoot)
+#define remoteFrees (arena->remoteFrees)
+#define slabs (arena->slabs)
+#define fastbins (arena->fastbins)
+#define fastCount (arena->fastCount)
+#define rover (arena->rover)
+#define idxSizes (arena->idxSizes)
+#define idxBlocks (arena->idxBlocks)
+#define idxLen (arena->idxLen)
+#define idxCap (arena->idxCap)
+#define idxBroken (arena->idxBroken)
+
+/* REGIONS
+ * A region hands out memory by moving next up towards end in its newest
+ * chunk. Chunks are plain heap blocks from the calling thread's home
+ * arena, never mapped on their own whatever their size, each starting
+ * with a regionchunk_t that links back to the chunk before it. The region
+ * itself sits right after the header of its first chunk of REGION_CHUNK
+ * bytes, so a reset frees every chunk but that one and destroy all of
+ * them. A chunk is as much as one SBRK_SIZE step of a fresh heap holds.
+ */
+#define REGION_CHUNK (SBRK_SIZE - BLOCK_OVERHEAD - START_FENCE_SIZE - END_FENCE_SIZE)
+typedef struct regionchunk {
+    struct regionchunk* prev;
+} regionchunk_t;
+
+struct region {
+    regionchunk_t* chunks;
+    char* next;
+    char* end;
+};
+
+/*
+Allocates size bytes for the my_malloc_* function of the given order. Requests over the mmap threshold get a mapping of their own. Small ones are tried on the slabs, the thread cache and the fast lists first. Everything else comes out of the calling thread's home arena, switched to order.
+
+Postconditions:
+- pointer to the start of the user's memory is returned, or NULL with ERRNO set
+*/
+void* mallocInOrder(enum ORDER order, size_t size)
+{
     /*
-    If user request exceeds 2048 bytes (after metadata), set code
-    SINGLE_REQUEST_TOO_LARGE and return null.
+    If user request is over the mmap threshold, it gets a mapping of its
+    own instead of coming out of the heap.
     */
-    if (size + sizeof(metadata_t) > SBRK_SIZE) {
-        ERRNO = SINGLE_REQUEST_TOO_LARGE;
-        return NULL;
+    if (size > mmapThreshold) {
+        return mapLarge(size);
     }
-
-    /* If free list is empty, get new block from my_sbrk */
-    if (freelist == NULL) {
-        metadata_t *temp = (metadata_t *) my_sbrk(SBRK_SIZE);
-        /*
-        If my_sbrk returns null, we are out of heap space. Set code
-        OUT_OF_MEMORY and return null.
-        */
-        if (temp == NULL) {
-            ERRNO = OUT_OF_MEMORY;
-            return NULL;
-        } else {
-            freelist = temp;
+#ifdef SLAB
+    if (size <= slabThreshold) {
+        void* slot = allocSlot(size);
+        if (slot != NULL) {
+            ERRNO = NO_ERROR;
+            return slot;
         }
-        freelist->in_use = 0;
-        freelist->size = SBRK_SIZE;
-        // prev and next pointers are already null
     }
-    void *ret = getMemory(size);
+#endif
+#ifdef THREAD_CACHE
+    void* cached = takeFromCache(size);
+    if (cached != NULL) {
+        ERRNO = NO_ERROR;
+        return cached;
+    }
+#endif
+    useHomeArena();
+    LOCK_HEAP();
+    setOrder(order);
+#ifdef THREAD_SAFE
+    drainRemoteFrees();
+#endif
+    void* fast = takeFromFastbin(size);
+    if (fast != NULL) {
+        UNLOCK_HEAP();
+        ERRNO = NO_ERROR;
+        return fast;
+    }
+    void *ret = getMemoryFromArena(size);
+#ifdef THREAD_CACHE
+    if (ret != NULL) {
+        fillCache(size);
+    }
+#endif
+    UNLOCK_HEAP();
     if (ret != NULL) {
         ERRNO = NO_ERROR;
         return ret;
@@ -69,42 +536,181 @@ void* my_malloc_size_order(size_t size)
     }
 }
 
+/*
+Frees ptr for the my_free_* function of the given order. Slots, cached blocks and mappings go back the way they came. Anything else is merged with its free neighbors in the arena it came from, switched to order, unless it can wait on a fast list.
+*/
+void freeInOrder(enum ORDER order, void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+#ifdef SLAB
+    /* Slots have no header to look at, so they are picked out first. */
+    if (freeSlot(ptr)) {
+        ERRNO = NO_ERROR;
+        return;
+    }
+#endif
+    metadata_t* head = HEADER_OF(ptr);
+#ifdef THREAD_CACHE
+    if (putInCache(head)) {
+        ERRNO = NO_ERROR;
+        return;
+    }
+#endif
+    /* Large blocks were never part of the heap, so they go straight back.
+    With COMPACT_HEADER, freeing the block before this one rewrites the
+    same word under the lock, so it is read through peekHeader. */
+    metadata_t peek = peekHeader(head);
+    if (IS_MMAPPED(&peek)) {
+        unmapLarge(head);
+        return;
+    }
+    useArenaOf(head);
+#ifdef THREAD_SAFE
+    /* If another thread has the block's arena, the block is left on the
+    remote free list for it instead of waiting for the lock. */
+    if (pthread_mutex_trylock(&arena->lock) != 0) {
+        deferFree(head, head);
+        ERRNO = NO_ERROR;
+        return;
+    }
+#endif
+    /* coalesceLeftAndRight and addToFreeList pull neighbors out of and put
+    the result into whatever structures order keeps. */
+    setOrder(order);
+    /* A small block waits on a fast list instead of being merged. */
+    if (putInFastbin(head)) {
+        UNLOCK_HEAP();
+        ERRNO = NO_ERROR;
+        return;
+    }
+    metadata_t* addThis = coalesceLeftAndRight(ptr);
+    addToFreeList(addThis);
+    UNLOCK_HEAP();
+    ERRNO = NO_ERROR;
+}
+
+void* my_malloc_size_order(size_t size)
+{
+    return mallocInOrder(SIZE, size);
+}
+
 void* my_malloc_addr_order(size_t size)
 {
-    sortBy = ADDRESS;
-    /*
-    If user request exceeds 2048 bytes (after metadata), set code
-    SINGLE_REQUEST_TOO_LARGE and return null.
-    */
-    if (size + sizeof(metadata_t) > SBRK_SIZE) {
+    return mallocInOrder(ADDRESS, size);
+}
+
+void* my_malloc_next_fit(size_t size)
+{
+    return mallocInOrder(NEXT_FIT, size);
+}
+
+void* my_malloc_good_fit(size_t size)
+{
+    return mallocInOrder(GOOD_FIT, size);
+}
+
+/*
+Returns the size of the block needed to hand the user size bytes, metadata included. With COMPACT_HEADER this is rounded up to BLOCK_ALIGN so every header stays word aligned, with SIDE_METADATA to whole cache lines, and it is raised to MIN_BLOCK_SIZE so the block can hold its links and footer once it is freed.
+*/
+size_t getBlockSize(size_t size) {
+    size_t need = (size + BLOCK_OVERHEAD + BLOCK_ALIGN - 1) & ~((size_t) BLOCK_ALIGN - 1);
+    if (need < MIN_BLOCK_SIZE) {
+        need = MIN_BLOCK_SIZE;
+    }
+    return need;
+}
+
+/*
+Gives a request over the mmap threshold a mapping of its own from my_mmap. The mapping holds the length to unmap later, then the block's metadata marked IS_MMAPPED, then the user's memory, which starts LARGE_OVERHEAD bytes in. None of it is ever on the freelist or in the heap, so there is nothing to split or coalesce.
+
+Postconditions:
+- pointer to the start of the user's memory is returned and ERRNO is NO_ERROR
+- if size is too large to even add the metadata to, ERRNO is SINGLE_REQUEST_TOO_LARGE and NULL is returned
+- if my_mmap fails, ERRNO is OUT_OF_MEMORY and NULL is returned
+*/
+void* mapLarge(size_t size) {
+    if (size > SIZE_MAX - LARGE_OVERHEAD) {
         ERRNO = SINGLE_REQUEST_TOO_LARGE;
         return NULL;
     }
+    size_t length = size + LARGE_OVERHEAD;
+    char* map = (char*) my_mmap(length);
+    if (map == NULL) {
+        ERRNO = OUT_OF_MEMORY;
+        return NULL;
+    }
+    metadata_t* blk = (metadata_t*) (map + LARGE_OVERHEAD - MAPPED_HEADER_SIZE);
+    char* chunk = ((char*) blk) - sizeof(size_t);
+    *(size_t*) chunk = length;
+    SET_MMAPPED(blk);
+    ERRNO = NO_ERROR;
+    return ((char*) blk) + MAPPED_HEADER_SIZE;
+}
 
-    /* If free list is empty, get new block from my_sbrk */
-    if (freelist == NULL) {
-        metadata_t *temp = (metadata_t *) my_sbrk(SBRK_SIZE);
-        /*
-        If my_sbrk returns null, we are out of heap space. Set code
-        OUT_OF_MEMORY and return null.
-        */
-        if (temp == NULL) {
-            ERRNO = OUT_OF_MEMORY;
-            return NULL;
-        } else {
-            freelist = temp;
-        }
-        freelist->in_use = 0;
-        freelist->size = SBRK_SIZE;
-        // prev and next pointers are already null
+/*
+Returns the size and flags of blk without the lock. blk has to be a block the caller owns, that is one in use, but with COMPACT_HEADER and THREAD_SAFE the lock holder may still be flipping its PINUSE bit, so head is read in one go.
+*/
+metadata_t peekHeader(metadata_t* blk) {
+    metadata_t copy = {0};
+#ifdef COMPACT_HEADER
+    copy.head = __atomic_load_n(&blk->head, __ATOMIC_RELAXED);
+#else
+    copy.in_use = blk->in_use;
+    copy.size = blk->size;
+#endif
+    return copy;
+}
+
+/*
+Like mapLarge, but the user's memory starts on a multiple of alignment. The mapping is made alignment bytes longer so there is room to slide the block up, and any whole pages that leaves in front of it are unmapped straight away. The length kept in front of the metadata then counts from the start of the page the block's mapping now starts in.
+
+Preconditions:
+- alignment is a power of two
+*/
+void* mapLargeAligned(size_t size, size_t alignment) {
+    if (size > SIZE_MAX - LARGE_OVERHEAD - alignment) {
+        ERRNO = SINGLE_REQUEST_TOO_LARGE;
+        return NULL;
     }
-    void *ret = getMemory(size);
-    if (ret != NULL) {
-        ERRNO = NO_ERROR;
-        return ret;
-    } else {
+    size_t length = size + LARGE_OVERHEAD + alignment;
+    char* map = (char*) my_mmap(length);
+    if (map == NULL) {
+        ERRNO = OUT_OF_MEMORY;
         return NULL;
     }
+    char* ret = (char*) ROUND_UP((uintptr_t) map + LARGE_OVERHEAD, alignment);
+    metadata_t* blk = (metadata_t*) (ret - MAPPED_HEADER_SIZE);
+    char* chunk = ((char*) blk) - sizeof(size_t);
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t lead = (size_t) (chunk - map) / page * page;
+    if (lead != 0) {
+        my_munmap(map, lead);
+    }
+    *(size_t*) chunk = length - lead;
+    SET_MMAPPED(blk);
+    ERRNO = NO_ERROR;
+    return ret;
+}
+
+/* Returns the page a block from mapLarge or mapLargeAligned starts in, which is where its mapping starts. */
+char* getMapping(metadata_t* blk) {
+    char* chunk = ((char*) blk) - sizeof(size_t);
+    return (char*) ((uintptr_t) chunk & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1));
+}
+
+/* Returns how many bytes the user can use of a block from mapLarge or mapLargeAligned. */
+size_t getMappedSize(metadata_t* blk) {
+    char* chunk = ((char*) blk) - sizeof(size_t);
+    return (size_t) (getMapping(blk) + *(size_t*) chunk - (((char*) blk) + MAPPED_HEADER_SIZE));
+}
+
+/* Returns a block from mapLarge or mapLargeAligned to the system, mapping and all. */
+void unmapLarge(metadata_t* blk) {
+    char* chunk = ((char*) blk) - sizeof(size_t);
+    my_munmap(getMapping(blk), *(size_t*) chunk);
+    ERRNO = NO_ERROR;
 }
 
 /*
@@ -113,7 +719,7 @@ This large funciton does all of the following:
 - Removes block from freelist.
 - Splits it if necessary and returns leftover block to freelist.
 - Updates metadata and returns pointer to start of user's memory
-Includes some questionable use of recursion to expand freelist size with my_sbrk in the event that there is not enough memory in freelist to suit user's request.
+If nothing in the freelist fits, the heap is grown once with extendHeap, by an amount chosen by growPolicy, and the user's block is cut from the front of the free block that comes back.
 
 Preconditions:
 - freelist is not NULL.
@@ -123,6 +729,7 @@ Postconditions:
 - freelist has been updated to remove user's memory and sometimes readd leftover memory
 */
 void* getMemory(size_t size) {
+    size_t need = getBlockSize(size);
     metadata_t* index = freelist;
     /* end of list, set if we reach end of free list w/o finding adequate
     memory space */
@@ -130,33 +737,46 @@ void* getMemory(size_t size) {
 
     /* For SIZE, iterate through freelist until the first block of adequate size is found. */
     if (sortBy == SIZE) {
-        do {
+#ifdef FREE_INDEX
+        /* The index goes straight to the block the walk would stop at. */
+        if (!idxBroken) {
+            index = findInIndex(need);
+            eol = index == NULL;
+        }
+#endif
+        while (!eol) {
             /* Test if block [is available and] of adequate size */
-            if (index->in_use == 0 && index->size >= size + sizeof(metadata_t)) {
-                short blkSize = index->size;
+            if (IS_IN_USE(index) == 0 && (size_t) GET_SIZE(index) >= need) {
+                size_t blkSize = GET_SIZE(index);
                 /* Handle if leftover is smaller than sizeof(metadata). In
                 this case, simply return the whole memory block. */
-                if (size + (sizeof(metadata_t) * 2) + 1 >= blkSize) {
+                if (need + MIN_BLOCK_SIZE + 1 >= blkSize) {
                     removeFromFreelist(index);
-                    index->in_use = 1;
-                    void* ret = ((char*) index) + sizeof(metadata_t);
+                    SET_IN_USE(index, 1);
+#ifdef BOUNDARY_TAGS
+                    setFooter(index);
+#endif
+                    void* ret = USER_PTR(index);
                     return ret;
                 }
                 /* Otherwise split into two blocks, "index" which the user will
                 use and "leftover" which will return to the freelist. */
-                metadata_t* leftover = (metadata_t*) (((char*) index) + size + sizeof(metadata_t));
-                leftover->size = blkSize - size - sizeof(metadata_t);
-                leftover->in_use = 0;
+                metadata_t* leftover = BLOCK_AFTER(index, need);
+                SET_SIZE(leftover, blkSize - need);
+                SET_IN_USE(leftover, 0);
                 leftover->next = NULL;
                 leftover->prev = NULL;
 
                 removeFromFreelist(index);
-                index->size = size + sizeof(metadata_t);
-                index->in_use = 1;
+                SET_SIZE(index, need);
+                SET_IN_USE(index, 1);
+#ifdef BOUNDARY_TAGS
+                setFooter(index);
+#endif
 
                 addToFreeList(leftover);
 
-                void* ret = (void*) (((char*) index) + sizeof(metadata_t));
+                void* ret = USER_PTR(index);
                 return ret;
             }
 
@@ -167,19 +787,59 @@ void* getMemory(size_t size) {
             } else {
                 eol = 1;
             }
-        } while (!eol);
+        }
+    /* For NEXT_FIT and GOOD_FIT, the search stops early, so the block is taken as soon as it is found. */
+    } else if (sortBy == NEXT_FIT || sortBy == GOOD_FIT) {
+        metadata_t* found = sortBy == NEXT_FIT ? findNextFit(need) : findGoodFit(need);
+        if (found != NULL) {
+            if (sortBy == NEXT_FIT) {
+                rover = found;
+            }
+            return takeFreeBlock(found, need);
+        }
+#ifdef BOUNDARY_TAGS
+    /* For ADDRESS with BOUNDARY_TAGS, the trees pick the best fit, lowest address first on ties, without looking at the whole freelist. */
+    } else if (sortBy == ADDRESS) {
+        if (need < TREE_MIN_SIZE) {
+            need = TREE_MIN_SIZE;
+        }
+        metadata_t* bestFit = findBestFitInTree(need);
+        if (bestFit != NULL) {
+            removeFromFreelist(bestFit);
+            /* Only split if the leftover is big enough to go in the trees. */
+            if ((size_t) GET_SIZE(bestFit) >= need + TREE_MIN_SIZE) {
+                metadata_t* leftover = BLOCK_AFTER(bestFit, need);
+                SET_SIZE(leftover, GET_SIZE(bestFit) - need);
+                leftover->next = NULL;
+                leftover->prev = NULL;
+                SET_SIZE(bestFit, need);
+                addToFreeList(leftover);
+            }
+            SET_IN_USE(bestFit, 1);
+            setFooter(bestFit);
+            void* ret = USER_PTR(bestFit);
+            return ret;
+        }
+#else
     /* For ADDRESS, iterate though the entire freelist first, and decide which block fits best after checking them all. */
     } else if (sortBy == ADDRESS) {
-        metadata_t* bestFit;
-        short bestSize = 8193;
-        do {
+        metadata_t* bestFit = NULL;
+        size_t bestSize = SIZE_MAX;
+#ifdef FREE_INDEX
+        if (!idxBroken) {
+            bestFit = findInIndex(need);
+            bestSize = bestFit != NULL ? (size_t) GET_SIZE(bestFit) : SIZE_MAX;
+            eol = 1;
+        }
+#endif
+        while (!eol) {
             /* Test if block is [available and] of adequate size. In the case of a tie between sizes, the first occurence in memory is used. */
-            if (index->in_use == 0 && index->size >= size + sizeof(metadata_t) && index->size < bestSize) {
+            if (IS_IN_USE(index) == 0 && (size_t) GET_SIZE(index) >= need && GET_SIZE(index) < bestSize) {
                 bestFit = index;
                 bestFit->prev = index->prev;
                 bestFit->next = index->next;
-                bestFit->size = index->size;
-                bestSize = index->size;
+                SET_SIZE(bestFit, GET_SIZE(index));
+                bestSize = GET_SIZE(index);
             }
             /* If next is not null, there is more memory to test. Otherwise, stop iterating. */
             if (index->next != NULL) {
@@ -187,229 +847,2599 @@ void* getMemory(size_t size) {
             } else {
                 eol = 1;
             }
-        } while (!eol);
+        }
 
         /* If bestSize was not changed, no adequate memory was found, and so drop through to my_sbrk call. */
-        if (bestSize != 8193) {
+        if (bestSize != SIZE_MAX) {
             index = bestFit; // for consistency with SIZE
             index->prev = bestFit->prev;
             index->next = bestFit->next;
-            index->size = bestFit->size;
+            SET_SIZE(index, GET_SIZE(bestFit));
 
             removeFromFreelist(index);
-            index->in_use = 1;
+            SET_IN_USE(index, 1);
 
             /* Test if leftover is larger than sizeof(metadata). If not,
             simply drop through and return the whole memory block. */
-            if ((size + (sizeof(metadata_t) * 2)) + 1 <= index->size) {
+            if (need + MIN_BLOCK_SIZE + 1 <= (size_t) GET_SIZE(index)) {
                 /* Split into two blocks, "index" which the user will
                 use and "leftover" which will return to the freelist. */
-                index->size = size + sizeof(metadata_t);
+                SET_SIZE(index, need);
+
+                metadata_t* leftover = BLOCK_AFTER(index, need);
+                SET_SIZE(leftover, bestSize - need);
+                SET_IN_USE(leftover, 0);
+                leftover->next = NULL;
+                leftover->prev = NULL;
+
+                addToFreeList(leftover);
+            }
+#ifdef BOUNDARY_TAGS
+            setFooter(index);
+#endif
+            void* ret = USER_PTR(index);
+            return ret;
+        }
+#endif
+    }
+
+    /*
+    If we reach this point, there was not enough memory in freelist to accomodate request. We need to call my_sbrk. extendHeap grows the heap by enough in one go, so the user gets the start of the new block straight away without searching the freelist again.
+    */
+    metadata_t *temp = extendHeap(need);
+    /*
+    If my_sbrk returns null, we are out of heap space. extendHeap has
+    already set code OUT_OF_MEMORY, so just return null.
+    */
+    if (temp == NULL) {
+        return NULL;
+    }
+    if ((size_t) GET_SIZE(temp) >= need + MIN_BLOCK_SIZE) {
+        metadata_t* leftover = BLOCK_AFTER(temp, need);
+        SET_SIZE(leftover, GET_SIZE(temp) - need);
+        leftover->next = NULL;
+        leftover->prev = NULL;
+        SET_SIZE(temp, need);
+        addToFreeList(leftover);
+    }
+    SET_IN_USE(temp, 1);
+#ifdef BOUNDARY_TAGS
+    setFooter(temp);
+#endif
+    return USER_PTR(temp);
+}
+
+/*
+Grows the heap by enough for a free block of at least need bytes, counting the free block on top of the heap if there is one, and sets the new memory up as a single free block merged with that one. How much the heap actually grows by is up to growPolicy. If my_sbrk cannot give that much, it is asked once more for just what is needed.
+The block is NOT added to the freelist, that is up to the caller.
+With BOUNDARY_TAGS, if the new memory starts exactly where our heap used to end, the old end fence post becomes the header of the new block so that findLeftBlk can see the block that used to be last. Otherwise this is either our first call or someone else moved the break since our last call, so the new memory gets a fence post of its own at its start.
+
+Postconditions:
+- if my_sbrk fails, ERRNO is set to OUT_OF_MEMORY and NULL is returned
+- otherwise returned block is at least need bytes, has in_use = 0 and null prev and next references
+*/
+metadata_t* extendHeap(size_t need) {
+    /* When the heap grows in place, the free block on top of it counts
+    toward need, as long as the two can still be merged. Otherwise the new
+    memory needs fence posts of its own. */
+    size_t fences = START_FENCE_SIZE + END_FENCE_SIZE;
+#ifdef BOUNDARY_TAGS
+    if (heapEnd != NULL && (char*) arenaSbrk(0) == heapEnd) {
+        fences = 0;
+    }
+#endif
+#ifdef SIDE_METADATA
+    /* Blocks only start on granules, so if anyone else left the break off
+    one, the heap grows from the next one up. */
+    if (arena->sideTable == NULL && !mapSideTable()) {
+        ERRNO = OUT_OF_MEMORY;
+        return NULL;
+    }
+    char* brk = (char*) arenaSbrk(0);
+    size_t pad = ROUND_UP((uintptr_t) brk, SIDE_GRANULE) - (uintptr_t) brk;
+    if (pad != 0 && arenaSbrk((int) pad) == NULL) {
+        ERRNO = OUT_OF_MEMORY;
+        return NULL;
+    }
+#endif
+    metadata_t* top = findTopBlk();
+    size_t have = top != NULL ? (size_t) GET_SIZE(top) : 0;
+    /* TLSF only looks in lists whose every block fits, so it can pass over
+    a top block that is already big enough. */
+    if (have >= need) {
+        removeFromFreelist(top);
+        top->next = NULL;
+        top->prev = NULL;
+        return top;
+    }
+    size_t minGrow = ROUND_UP(need > have ? need - have : 0, SBRK_SIZE);
+    if (have != 0 && have + minGrow > MAX_BLOCK_SIZE) {
+        top = NULL;
+        have = 0;
+        minGrow = ROUND_UP(need, SBRK_SIZE);
+    }
+    minGrow = ROUND_UP(minGrow + fences, SBRK_SIZE);
+    if (minGrow > MAX_GROW) {
+        ERRNO = OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    size_t grow = ROUND_UP(minGrow, growChunk);
+    if (growPolicy == GROW_GEOMETRIC && grow < heapSize) {
+        grow = heapSize;
+    }
+    size_t maxGrow = top != NULL ? (MAX_BLOCK_SIZE - have) / SBRK_SIZE * SBRK_SIZE : MAX_GROW;
+    if (grow > maxGrow) {
+        grow = maxGrow;
+    }
+    char* chunk = (char*) arenaSbrk((int) grow);
+    if (chunk == NULL && grow > minGrow) {
+        grow = minGrow;
+        chunk = (char*) arenaSbrk((int) grow);
+    }
+    if (chunk == NULL) {
+        ERRNO = OUT_OF_MEMORY;
+        return NULL;
+    }
+    heapSize += grow;
+    metadata_t* temp;
+#ifdef COMPACT_HEADER
+    /* With compact headers the fence posts are a single word. There is no
+    start fence, the first block just claims an in-use left neighbor through
+    PINUSE. The end fence is a header with only CINUSE set, and is reused as
+    the first word of the next chunk when the heap grows contiguously, so it
+    carries over whether the block before it was in use. */
+    if (chunk == heapEnd) {
+        temp = (metadata_t*) (chunk - END_FENCE_SIZE);
+        SET_SIZE(temp, grow);
+    } else {
+        temp = (metadata_t*) chunk;
+        temp->head = (grow - END_FENCE_SIZE) | PINUSE;
+    }
+    heapEnd = chunk + grow;
+    ((metadata_t*) (heapEnd - END_FENCE_SIZE))->head = CINUSE;
+#elif defined(BOUNDARY_TAGS)
+    if (chunk == heapEnd) {
+        temp = (metadata_t*) (chunk - END_FENCE_SIZE);
+        temp->size = grow;
+    } else {
+        footer_t* startFence = (footer_t*) (chunk + START_FENCE_SIZE - FOOTER_SIZE);
+        startFence->in_use = 1;
+        startFence->size = 0;
+        temp = (metadata_t*) (chunk + START_FENCE_SIZE);
+        temp->size = grow - START_FENCE_SIZE - END_FENCE_SIZE;
+    }
+    heapEnd = chunk + grow;
+    /* The end fence post is only ever read for in_use, which sits at the
+    front of a metadata_t just like it does in a footer_t. */
+    footer_t* endFence = (footer_t*) (heapEnd - END_FENCE_SIZE);
+    endFence->in_use = 1;
+    endFence->size = 0;
+#else
+    temp = BLOCK_AT(chunk);
+    temp->size = grow;
+#endif
+    SET_IN_USE(temp, 0);
+
+    /* Merge with the old top of the heap. It has to come off the freelist
+    before its size changes, since the bins and trees are keyed by size. */
+    if (top != NULL) {
+        removeFromFreelist(top);
+        SET_SIZE(top, have + GET_SIZE(temp));
+        temp = top;
+    }
+    temp->next = NULL;
+    temp->prev = NULL;
+#ifdef BOUNDARY_TAGS
+    setFooter(temp);
+#endif
+    return temp;
+}
+
+#ifdef BOUNDARY_TAGS
+/* Returns the footer sitting in the last bytes of blk, based on blk's current size. */
+footer_t* getFooter(metadata_t* blk) {
+    return (footer_t*) (((char*) blk) + GET_SIZE(blk) - sizeof(footer_t));
+}
+
+/*
+Copies blk's in_use and size into its footer. Must be called every time either one changes, since the left neighbor lookup trusts the footer and never looks at the header.
+With COMPACT_HEADER only free blocks have a footer, and in_use lives in the PINUSE bit of the right neighbor's header instead, so that bit is what gets updated here.
+*/
+void setFooter(metadata_t* blk) {
+#ifdef COMPACT_HEADER
+    metadata_t* right = BLOCK_AFTER(blk, GET_SIZE(blk));
+    /* right may be in use and looked at by its owner through peekHeader
+    while this runs, so with THREAD_SAFE the bit is flipped atomically. */
+    if (IS_IN_USE(blk)) {
+#ifdef THREAD_SAFE
+        __atomic_fetch_or(&right->head, PINUSE, __ATOMIC_RELAXED);
+#else
+        right->head |= PINUSE;
+#endif
+    } else {
+        getFooter(blk)->size = GET_SIZE(blk);
+#ifdef THREAD_SAFE
+        __atomic_fetch_and(&right->head, ~PINUSE, __ATOMIC_RELAXED);
+#else
+        right->head &= ~PINUSE;
+#endif
+    }
+#else
+    footer_t* foot = getFooter(blk);
+    foot->in_use = blk->in_use;
+    foot->size = blk->size;
+#endif
+}
+#endif
+
+/*
+Removes index from the free list by updating previous and next references.
+Pointers in C are glorious and amazing.
+
+Preconditions:
+- index is pointing the the metadata, not the user's address
+*/
+void removeFromFreelist(metadata_t* index) {
+    if (index == rover) {
+        rover = index->next;
+    }
+#ifdef FREE_INDEX
+    if (INDEXED(sortBy)) {
+        removeFromIndex(index);
+    }
+#endif
+#ifdef BOUNDARY_TAGS
+    if (ADDRESS_ORDERED(sortBy) && (size_t) GET_SIZE(index) >= TREE_MIN_SIZE) {
+        /* Falls through to unlink it from the freelist as well. */
+        removeFromTree(index);
+    }
+    if (sortBy == SEGREGATED) {
+        removeFromBin(index);
+        return;
+    }
+    if (sortBy == TLSF) {
+        removeFromTLSF(index);
+        return;
+    }
+#endif
+    if (index->prev == NULL && index->next == NULL) {
+        /* If index's prev and next are null, we know that we have
+        requested the only memory available in the freelist. Thus,
+        the freelist is now empty. */
+        freelist = NULL;
+    } else if (index->prev == NULL) {
+        /* Update the alloced memory's next block's prev to null,
+        since the alloced memory is being removed.
+        Further, if index's prev is null, we know we must be at the
+        head of the freelist. Thus, update freelist pointer. */
+        metadata_t* temp = index->next;
+        temp->prev = NULL;
+        freelist = temp;
+    } else if (index->next == NULL) {
+        /* Update the alloced memory's prev block's next to null,
+        since the alloced memory is being removed.
+        For the record, since index's next is null, we know we must
+        be at the last node of the freelist. */
+        metadata_t* temp = index->prev;
+        temp->next = NULL;
+    } else {
+        /* Join the alloced memory's prev and next blocks, since the
+        alloced memory is being removed.
+        For the record, since index has a prev and next reference,
+        we know we are inclusively inside the freelist. */
+        metadata_t* Iprev = index->prev;
+        metadata_t* Inext = index->next;
+        Iprev->next = Inext;
+        Inext->prev = Iprev;
+    }
+}
+
+/*
+Iterate through the freelist until we find a memory block whose size/address is larger than our block to add. Our block to add should be inserted TO THE LEFT of this larger block.
+This is ONLY for adding to free list and does NOT attempt to coalesce with neighbors before adding. Thus, this should only be called through other methods in my_malloc in context, not accessed directly.
+
+Preconditions:
+- freelist is not NULL.
+- ptr is pointing to the metadata, not the user's address
+- ptr has ALREADY attempted to coalesce with neighbors
+Postconditions:
+- addThis has been added to the free list in appropriate order (size or address).
+*/
+void addToFreeList(metadata_t* addThis) {
+    SET_IN_USE(addThis, 0);
+#ifdef FREE_INDEX
+    /* The place is looked up before addThis is in the index itself. */
+    metadata_t* after = NULL;
+    int placed = 0;
+    if (INDEXED(sortBy)) {
+        placed = freelist != NULL && findListPlace(addThis, &after);
+        addToIndex(addThis);
+    }
+#endif
+#ifdef BOUNDARY_TAGS
+    setFooter(addThis);
+    if (sortBy == SEGREGATED) {
+        addToBin(addThis);
+        return;
+    }
+    if (sortBy == TLSF) {
+        addToTLSF(addThis);
+        return;
+    }
+    if (ADDRESS_ORDERED(sortBy)) {
+        addToTree(addThis);
+        return;
+    }
+#endif
+    /* Handle if free list is empty. */
+    if (freelist == NULL) {
+        freelist = addThis;
+        return;
+    }
+#ifdef FREE_INDEX
+    if (placed) {
+        metadata_t* before = after != NULL ? after->next : freelist;
+        addThis->prev = after;
+        addThis->next = before;
+        if (before != NULL) {
+            before->prev = addThis;
+        }
+        if (after != NULL) {
+            after->next = addThis;
+        } else {
+            freelist = addThis;
+        }
+        return;
+    }
+#endif
+    metadata_t *index = freelist;
+    int eol = 0;
+    if (sortBy == SIZE) {
+        while (!eol) {
+            if (GET_SIZE(index) > GET_SIZE(addThis)) {
+                /* If index's prev is null, it means we are at the start of
+                the free list (and our ptr to add is the smallest in the
+                list). Thus, update only next references references, and update freelist pointer. */
+                if (index->prev == NULL) {
+                    addThis->next = index;
+                    index->prev = addThis;
+                    freelist = addThis;
+                    return;
+                } else {
+                    /* Otherwise, we are somewhere in the middle of the free list, so update prev and next references. */
+                    metadata_t* Iprev = index->prev;
+                    addThis->prev = Iprev;
+                    Iprev->next = addThis;
+                    addThis->next = index;
+                    index->prev = addThis;
+                    return;
+                }
+            }
+            if (index->next == NULL) {
+                eol = 1;
+            } else {
+                index = index->next;
+            }
+        }
+        /* If the while loop terminates, our ptr to add is the largest in the
+        free list, so add it to the end. */
+        addThis->prev = index;
+        index->next = addThis;
+        return;
+    }
+    if (ADDRESS_ORDERED(sortBy)) {
+        while (!eol) {
+            if (index > addThis) {
+                /* If index's prev is null, it means we are at the start of
+                the free list (and our ptr to add is the smallest in the
+                list). Thus, update only next references, and update freelist pointer. */
+                if (index->prev == NULL) {
+                    addThis->next = index;
+                    index->prev = addThis;
+                    freelist = addThis;
+                    return;
+                } else {
+                    /* Otherwise, we are somewhere in the middle of the free list, so update prev and next references. */
+                    metadata_t* Iprev = index->prev;
+                    addThis->prev = Iprev;
+                    Iprev->next = addThis;
+                    addThis->next = index;
+                    index->prev = addThis;
+                    return;
+                }
+            }
+            if (index->next == NULL) {
+                eol = 1;
+            } else {
+                index = index->next;
+            }
+        }
+        /* If the while loop terminates, our ptr to add is the largest in the
+        free list, so add it to the end. */
+        addThis->prev = index;
+        index->next = addThis;
+        return;
+    }
+}
+
+void my_free_size_order(void* ptr)
+{
+    freeInOrder(SIZE, ptr);
+}
+
+void my_free_addr_order(void* ptr)
+{
+    freeInOrder(ADDRESS, ptr);
+}
+
+void my_free_next_fit(void* ptr)
+{
+    freeInOrder(NEXT_FIT, ptr);
+}
+
+void my_free_good_fit(void* ptr)
+{
+    freeInOrder(GOOD_FIT, ptr);
+}
+
+void* my_realloc(void* ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return allocBlock(size);
+    }
+    if (size == 0) {
+        freeBlock(ptr);
+        ERRNO = NO_ERROR;
+        return NULL;
+    }
+#ifdef SLAB
+    /* A slot keeps its place as long as the request still fits in it. */
+    slab_t* slab = slabOf(ptr);
+    if (slab != NULL) {
+        if (size <= slab->size) {
+            ERRNO = NO_ERROR;
+            return ptr;
+        }
+        return moveBlock(ptr, slab->size, size);
+    }
+#endif
+    metadata_t* head = HEADER_OF(ptr);
+    metadata_t peek = peekHeader(head);
+    if (IS_MMAPPED(&peek)) {
+        /* A mapping keeps its place until the block would fit in the heap. */
+        size_t have = getMappedSize(head);
+        if (size <= have && size > mmapThreshold) {
+            ERRNO = NO_ERROR;
+            return ptr;
+        }
+        return moveBlock(ptr, have, size);
+    }
+    if (size <= MAX_HEAP_REQUEST) {
+        useArenaOf(head);
+        LOCK_HEAP();
+        int resized = resizeInPlace(head, getBlockSize(size));
+        UNLOCK_HEAP();
+        if (resized) {
+            ERRNO = NO_ERROR;
+            return ptr;
+        }
+    }
+    return moveBlock(ptr, GET_SIZE(&peek) - BLOCK_OVERHEAD, size);
+}
+
+void* my_calloc(size_t nmemb, size_t size)
+{
+    if (nmemb != 0 && size > SIZE_MAX / nmemb) {
+        ERRNO = SINGLE_REQUEST_TOO_LARGE;
+        return NULL;
+    }
+    size_t total = nmemb * size;
+    /* A mapping of its own is fresh from the system, so already zero. */
+    if (total > mmapThreshold) {
+        return mapLarge(total);
+    }
+#ifdef SLAB
+    if (total <= slabThreshold) {
+        void* slot = allocSlot(total);
+        if (slot != NULL) {
+            memset(slot, 0, total);
+            ERRNO = NO_ERROR;
+            return slot;
+        }
+    }
+#endif
+    useHomeArena();
+    LOCK_HEAP();
+#ifdef THREAD_SAFE
+    drainRemoteFrees();
+#endif
+    /* Taken before the heap grows for this block, if it has to. */
+    char* untouched = (char*) my_sbrk_untouched(arena->index);
+    char* ret = (char*) getMemoryFromArena(total);
+    char* blkEnd = NULL;
+    if (ret != NULL) {
+        metadata_t* blk = HEAP_HEADER(ret);
+        blkEnd = BLOCK_MEM(blk) + GET_SIZE(blk);
+    }
+    UNLOCK_HEAP();
+    if (ret == NULL) {
+        return NULL;
+    }
+    clearBlock(ret, total, blkEnd, untouched);
+    ERRNO = NO_ERROR;
+    return ret;
+}
+
+void* my_memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        ERRNO = SINGLE_REQUEST_TOO_LARGE;
+        return NULL;
+    }
+    /* With COMPACT_HEADER every header, so every block, is already aligned
+    this far, and with SIDE_METADATA every block starts on a cache line. */
+    if (alignment < BLOCK_ALIGN) {
+        alignment = BLOCK_ALIGN;
+    }
+    useHomeArena();
+    LOCK_HEAP();
+    /* Room for the request wherever it is aligned to, with enough in front
+    of it for the slop there to be freed as a block of its own. */
+    size_t lead = SPLIT_MIN(sortBy);
+    if (size > SIZE_MAX - alignment - lead || size + alignment + lead > mmapThreshold) {
+        UNLOCK_HEAP();
+        return mapLargeAligned(size, alignment);
+    }
+#ifdef THREAD_SAFE
+    drainRemoteFrees();
+#endif
+    char* ret = (char*) getMemoryFromArena(size + alignment + lead);
+    if (ret == NULL) {
+        UNLOCK_HEAP();
+        return NULL;
+    }
+    metadata_t* blk = HEAP_HEADER(ret);
+    char* aligned = (char*) ROUND_UP((uintptr_t) ret, alignment);
+    if (aligned != ret) {
+        /* Cut the slop off the front as an in-use block and free it, so it
+        merges with a free left neighbor like any other block. */
+        aligned = (char*) ROUND_UP((uintptr_t) ret + lead, alignment);
+        metadata_t* alignedBlk = HEAP_HEADER(aligned);
+        size_t blkSize = GET_SIZE(blk);
+        size_t leadSize = BLOCK_MEM(alignedBlk) - BLOCK_MEM(blk);
+        SET_SIZE(blk, leadSize);
+        SET_SIZE(alignedBlk, blkSize - leadSize);
+        SET_IN_USE(alignedBlk, 1);
+#ifdef BOUNDARY_TAGS
+        setFooter(blk);
+        setFooter(alignedBlk);
+#endif
+        addToFreeList(coalesceLeftAndRight(ret));
+        blk = alignedBlk;
+    }
+    /* The slop at the back goes the same way. */
+    resizeInPlace(blk, getBlockSize(size));
+    UNLOCK_HEAP();
+    ERRNO = NO_ERROR;
+    return aligned;
+}
+
+void* my_aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment == 0 || size % alignment != 0) {
+        ERRNO = SINGLE_REQUEST_TOO_LARGE;
+        return NULL;
+    }
+    return my_memalign(alignment, size);
+}
+
+size_t my_malloc_batch(size_t size, size_t count, void** out)
+{
+    size_t done = 0;
+    if (size > mmapThreshold) {
+        while (done < count && (out[done] = mapLarge(size)) != NULL) {
+            done++;
+        }
+        return done;
+    }
+    size_t need = getBlockSize(size);
+    size_t most = (MAX_HEAP_REQUEST + BLOCK_OVERHEAD) / need;
+    size_t k = count < most ? count : most;
+    useHomeArena();
+    LOCK_HEAP();
+#ifdef THREAD_SAFE
+    drainRemoteFrees();
+#endif
+    /* Take room for as many of the blocks as are left in one go, and cut
+    it up. If there is no room that big, try for half as many. */
+    while (done < count && k > 0) {
+        if (k > count - done) {
+            k = count - done;
+        }
+        char* ret = (char*) getMemoryFromArena(k * need - BLOCK_OVERHEAD);
+        if (ret == NULL) {
+            k /= 2;
+            continue;
+        }
+        metadata_t* blk = HEAP_HEADER(ret);
+        size_t left = GET_SIZE(blk);
+        for (size_t i = 0; i < k; i++) {
+            /* The last block gets whatever was too little to split off. */
+            size_t blkSize = i + 1 < k ? need : left;
+            SET_SIZE(blk, blkSize);
+            SET_IN_USE(blk, 1);
+#ifdef BOUNDARY_TAGS
+            setFooter(blk);
+#endif
+            out[done++] = USER_PTR(blk);
+            left -= blkSize;
+            blk = BLOCK_AFTER(blk, blkSize);
+        }
+    }
+    UNLOCK_HEAP();
+    if (done == count) {
+        ERRNO = NO_ERROR;
+    }
+    return done;
+}
+
+void my_free_batch(void** ptrs, size_t n)
+{
+    qsort(ptrs, n, sizeof(void*), compareAddresses);
+    arena_t* locked = NULL;
+    /* The blocks freed so far that are next to each other, merged into one
+    in-use block that grows as long as the next pointer starts where it ends. */
+    metadata_t* run = NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i] == NULL) {
+            continue;
+        }
+        metadata_t* head = HEADER_OF(ptrs[i]);
+        arena_t* owner = NULL;
+        int inHeap = 1;
+#ifdef SLAB
+        inHeap = slabOf(ptrs[i]) == NULL;
+#endif
+        if (inHeap) {
+            metadata_t peek = peekHeader(head);
+            if (!IS_MMAPPED(&peek)) {
+                useArenaOf(head);
+                owner = arena;
+            }
+        }
+        if (run != NULL && owner == locked && BLOCK_AFTER(run, GET_SIZE(run)) == head && CAN_MERGE(run, head)) {
+            SET_SIZE(run, GET_SIZE(run) + GET_SIZE(head));
+            continue;
+        }
+        /* A run is only ever open while its arena is locked. */
+        if (run != NULL) {
+            arena = locked;
+            addToFreeList(coalesceLeftAndRight(USER_PTR(run)));
+            run = NULL;
+        }
+        if (locked != NULL && owner != locked) {
+            UNLOCK_HEAP();
+            locked = NULL;
+        }
+        /* Slots and mappings are freed one at a time, with no lock held. */
+        if (owner == NULL) {
+            freeBlock(ptrs[i]);
+            continue;
+        }
+        arena = owner;
+        if (locked == NULL) {
+            LOCK_HEAP();
+            locked = owner;
+        }
+        run = head;
+    }
+    if (run != NULL) {
+        arena = locked;
+        addToFreeList(coalesceLeftAndRight(USER_PTR(run)));
+        UNLOCK_HEAP();
+    }
+    useHomeArena();
+    ERRNO = NO_ERROR;
+}
+
+int my_mallopt(enum MALLOPT param, size_t value)
+{
+    int taken = 0;
+    switch (param) {
+    case MMAP_THRESHOLD:
+        if (value <= MAX_HEAP_REQUEST) {
+            mmapThreshold = value;
+            taken = 1;
+        }
+        break;
+    case TRIM_THRESHOLD:
+        trimThreshold = value;
+        taken = 1;
+        break;
+    case GROW_POLICY:
+        if (value == GROW_FIXED || value == GROW_GEOMETRIC) {
+            growPolicy = (enum GROW) value;
+            taken = 1;
+        }
+        break;
+    case GROW_CHUNK:
+        if (value != 0 && value <= MAX_GROW) {
+            growChunk = ROUND_UP(value, SBRK_SIZE);
+            taken = 1;
+        }
+        break;
+    case TCACHE_COUNT:
+#ifdef THREAD_CACHE
+        tcacheCount = value;
+        taken = 1;
+#endif
+        break;
+    case ARENA_COUNT:
+#ifdef THREAD_SAFE
+        if (value >= 1 && value <= MAX_ARENAS) {
+            arenaCount = value;
+            taken = 1;
+        }
+#endif
+        break;
+    case FASTBIN_MAX:
+        if (value <= FASTBIN_MAX_REQUEST) {
+            fastbinMax = value;
+            taken = 1;
+        }
+        break;
+    case GOOD_FIT_COUNT:
+        if (value != 0) {
+            goodFitCount = value;
+            taken = 1;
+        }
+        break;
+    case GOOD_FIT_SLACK:
+        goodFitSlack = value;
+        taken = 1;
+        break;
+    case SLAB_THRESHOLD:
+#ifdef SLAB
+        if (value <= SLAB_MAX_SIZE) {
+            slabThreshold = value;
+            taken = 1;
+        }
+#endif
+        break;
+    }
+    return taken;
+}
+
+int my_malloc_trim(size_t pad)
+{
+    size_t released = 0;
+    metadata_t* top;
+#ifdef THREAD_CACHE
+    /* The calling thread's cached blocks may be what is keeping the top
+    of the heap in use. */
+    releaseCache(NULL);
+#endif
+#ifdef THREAD_SAFE
+    pthread_once(&arenaOnce, initArenas);
+#endif
+    for (int i = 0; i < MAX_ARENAS; i++) {
+        arena = &arenas[i];
+        /* An arena that never grew has no heap to trim. */
+        if (heapSize == 0) {
+            continue;
+        }
+        LOCK_HEAP();
+#ifdef THREAD_SAFE
+        drainRemoteFrees();
+#endif
+        consolidateFastbins();
+        /* Without boundary tags blocks can only be found through the freelist,
+        so there is nothing to trim until something has been freed. */
+        while ((top = findTopBlk()) != NULL) {
+            removeFromFreelist(top);
+            size_t topSize = GET_SIZE(top);
+            size_t dropped = trimTop(top, pad);
+            released += dropped;
+            /* If the whole block went, the block before it is now on top and
+            may be free too, since free blocks are not always merged. */
+            if (dropped == topSize) {
+                continue;
+            }
+            top->next = NULL;
+            top->prev = NULL;
+            addToFreeList(top);
+            break;
+        }
+        UNLOCK_HEAP();
+    }
+    useHomeArena();
+    return released != 0;
+}
+
+my_heap_t* my_heap_create(void* region, size_t size, enum ORDER order)
+{
+#ifndef BOUNDARY_TAGS
+    if (order == SEGREGATED || order == TLSF) {
+        return NULL;
+    }
+#endif
+    size_t mapped = 0;
+    if (region == NULL) {
+        if (size == 0 || (region = my_mmap(size)) == NULL) {
+            return NULL;
+        }
+        mapped = size;
+    }
+    /* The heap's own bookkeeping goes at the start of the region, so a
+    mapping starts with it and is unmapped from heap on destroy. */
+    char* start = (char*) ROUND_UP((uintptr_t) region, HEAP_ALIGN);
+    char* heapStart = start + ROUND_UP(sizeof(arena_t), HEAP_ALIGN);
+#ifdef SIDE_METADATA
+    heapStart = (char*) ROUND_UP((uintptr_t) heapStart, SIDE_GRANULE);
+#endif
+    char* end = (char*) region + size;
+    if (end < heapStart || (size_t) (end - heapStart) < SBRK_SIZE) {
+        if (mapped != 0) {
+            my_munmap(region, mapped);
+        }
+        return NULL;
+    }
+    /* Set the handle up through arena like any other heap, then give the
+    caller's arena back. */
+    arena_t* saved = arena;
+    my_heap_t* heap = arena = (my_heap_t*) start;
+    *arena = (arena_t) { &arena->list };
+    sortBy = order;
+    arena->index = -1;
+    arena->region = heapStart;
+    arena->regionSize = end - heapStart;
+    arena->mapped = mapped;
+#ifdef THREAD_SAFE
+    pthread_mutex_init(&arena->lock, NULL);
+#endif
+    arena = saved;
+    return heap;
+}
+
+void* my_heap_malloc(my_heap_t* heap, size_t size)
+{
+    /* The handle only borrows arena, so my_malloc carries on where it was. */
+    arena_t* saved = arena;
+    arena = heap;
+    LOCK_HEAP();
+    void* ret = getMemoryFromArena(size);
+    UNLOCK_HEAP();
+    arena = saved;
+    if (ret != NULL) {
+        ERRNO = NO_ERROR;
+    }
+    return ret;
+}
+
+void my_heap_free(my_heap_t* heap, void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    arena_t* saved = arena;
+    arena = heap;
+    LOCK_HEAP();
+    metadata_t* addThis = coalesceLeftAndRight(ptr);
+    addToFreeList(addThis);
+    UNLOCK_HEAP();
+    arena = saved;
+    ERRNO = NO_ERROR;
+}
+
+void my_heap_destroy(my_heap_t* heap)
+{
+    /* Every block lives inside the region, so there is nothing to walk. */
+#ifdef FREE_INDEX
+    arena_t* saved = arena;
+    arena = heap;
+    dropIndex();
+    /* Put arena back before the handle can be unmapped from under it. */
+    arena = saved;
+#endif
+#ifdef SIDE_METADATA
+    if (heap->sideTable != NULL) {
+        my_munmap(heap->sideTable, heap->sideLen * sizeof(metadata_t));
+    }
+#endif
+#ifdef THREAD_SAFE
+    pthread_mutex_destroy(&heap->lock);
+#endif
+    if (heap->mapped != 0) {
+        my_munmap(heap, heap->mapped);
+    }
+}
+
+my_region_t* my_region_create()
+{
+    regionchunk_t* first = (regionchunk_t*) allocChunk(REGION_CHUNK);
+    if (first == NULL) {
+        return NULL;
+    }
+    first->prev = NULL;
+    my_region_t* region = (my_region_t*) (first + 1);
+    region->chunks = first;
+    region->next = (char*) (region + 1);
+    region->end = ((char*) first) + REGION_CHUNK;
+    ERRNO = NO_ERROR;
+    return region;
+}
+
+void* my_region_alloc(my_region_t* region, size_t size)
+{
+    char* ptr = (char*) ROUND_UP((uintptr_t) region->next, HEAP_ALIGN);
+    if (ptr > region->end || size > (size_t) (region->end - ptr)) {
+        /* Start a new chunk, big enough for this request if it is bigger
+        than a chunk. What was left of the old one is not used again. */
+        if (size > MAX_HEAP_REQUEST - sizeof(regionchunk_t) - HEAP_ALIGN) {
+            ERRNO = SINGLE_REQUEST_TOO_LARGE;
+            return NULL;
+        }
+        size_t chunkSize = sizeof(regionchunk_t) + HEAP_ALIGN + size;
+        if (chunkSize < REGION_CHUNK) {
+            chunkSize = REGION_CHUNK;
+        }
+        regionchunk_t* chunk = (regionchunk_t*) allocChunk(chunkSize);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->prev = region->chunks;
+        region->chunks = chunk;
+        region->end = ((char*) chunk) + chunkSize;
+        ptr = (char*) ROUND_UP((uintptr_t) (chunk + 1), HEAP_ALIGN);
+    }
+    region->next = ptr + size;
+    ERRNO = NO_ERROR;
+    return ptr;
+}
+
+void my_region_reset(my_region_t* region)
+{
+    regionchunk_t* first = ((regionchunk_t*) region) - 1;
+    while (region->chunks != first) {
+        regionchunk_t* chunk = region->chunks;
+        region->chunks = chunk->prev;
+        freeChunk(chunk);
+    }
+    region->next = (char*) (region + 1);
+    region->end = ((char*) first) + REGION_CHUNK;
+}
+
+void my_region_destroy(my_region_t* region)
+{
+    my_region_reset(region);
+    /* The region lives in its first chunk, so this has to go last. */
+    freeChunk(region->chunks);
+}
+
+/*
+Moves the break of the current arena by increment bytes and returns where it was, like my_sbrk. A heap handle's break moves within its region, any other arena's through my_sbrk_arena.
+
+Postconditions:
+- returns NULL and leaves the break alone if it would leave the arena's heap
+*/
+void* arenaSbrk(int increment) {
+    if (arena->region == NULL) {
+        return my_sbrk_arena(arena->index, increment);
+    }
+    char* ret = arena->region + arena->regionTop;
+    if ((increment > 0 && (size_t) increment > arena->regionSize - arena->regionTop)
+        || (increment < 0 && (size_t) -(long) increment > arena->regionTop)) {
+        return NULL;
+    }
+    arena->regionTop += increment;
+    return ret;
+}
+
+#ifdef SIDE_METADATA
+/*
+Maps the current arena's side table, the first time its heap grows. It has an entry for every SIDE_GRANULE from the break, moved up to the next granule, to the furthest the heap can ever grow. Only the pages of it that blocks start in ever cost any memory, see my_mmap_sparse.
+
+Postconditions:
+- returns 1 if the table is mapped, or 0 if it could not be
+*/
+int mapSideTable() {
+    char* brk = (char*) arenaSbrk(0);
+    char* end = arena->region != NULL ? arena->region + arena->regionSize : (char*) my_sbrk_end(arena->index);
+    if (brk == NULL || end == NULL) {
+        return 0;
+    }
+    char* base = (char*) ROUND_UP((uintptr_t) brk, SIDE_GRANULE);
+    size_t len = base < end ? (size_t) (end - base) / SIDE_GRANULE : 0;
+    metadata_t* table = len != 0 ? (metadata_t*) my_mmap_sparse(len * sizeof(metadata_t)) : NULL;
+    if (table == NULL) {
+        return 0;
+    }
+    arena->sideBase = base;
+    arena->sideLen = len;
+    /* Set last, since arenaIndexOf looks at it without the lock. */
+    __atomic_store_n(&arena->sideTable, table, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/*
+Returns the metadata of the block whose user memory starts at ptr. For a heap block that is its entry in the side table of the arena it is in, the current arena's being tried first. A block with a mapping of its own keeps its metadata right in front of ptr.
+*/
+metadata_t* findSideEntry(void* ptr) {
+    char* mem = (char*) ptr;
+    if (arena->sideTable != NULL && mem >= arena->sideBase && mem < arena->sideBase + arena->sideLen * SIDE_GRANULE) {
+        return BLOCK_AT(mem);
+    }
+    int owner = my_sbrk_owner(ptr);
+    if (owner >= 0) {
+        arena_t* a = &arenas[owner];
+        return a->sideTable + (mem - a->sideBase) / SIDE_GRANULE;
+    }
+    return (metadata_t*) (mem - MAPPED_HEADER_SIZE);
+}
+#endif
+
+/*
+Allocates size bytes from the current arena in whatever order it keeps, growing its heap if nothing fits. Nothing is ever mapped on its own, whatever the size.
+
+Preconditions:
+- the arena's lock is held
+Postconditions:
+- pointer to the start of the user's memory is returned
+- if size is more than the heap can hand out in one block, ERRNO is SINGLE_REQUEST_TOO_LARGE and NULL is returned
+- if the heap cannot grow enough, ERRNO is OUT_OF_MEMORY and NULL is returned
+*/
+void* getMemoryFromArena(size_t size) {
+    if (size > MAX_HEAP_REQUEST) {
+        ERRNO = SINGLE_REQUEST_TOO_LARGE;
+        return NULL;
+    }
+    /* Blocks on the fast lists are only merged back in once nothing the
+    heap has free fits, and then the search is tried again before it grows. */
+    if (fastCount != 0) {
+        void* ret = getMemoryByOrder(size);
+        if (ret != NULL) {
+            return ret;
+        }
+        consolidateFastbins();
+    }
+#ifdef BOUNDARY_TAGS
+    if (sortBy == SEGREGATED || sortBy == TLSF) {
+        return getMemoryFromBins(size);
+    }
+#endif
+    /* If free list is empty, get new block from my_sbrk */
+    if (freelist == NULL) {
+        metadata_t* temp = extendHeap(getBlockSize(size));
+        if (temp == NULL) {
+            return NULL;
+        }
+        addToFreeList(temp);
+    }
+    return getMemory(size);
+}
+
+/*
+Allocates size bytes from the free structures sortBy says are in use, the way the my_malloc_* function for that order would, but only out of memory the heap already has.
+
+Preconditions:
+- the arena's lock is held
+Postconditions:
+- pointer to the start of the user's memory is returned, or NULL if nothing free fits
+*/
+void* getMemoryByOrder(size_t size) {
+    size_t need = getBlockSize(size);
+#ifdef BOUNDARY_TAGS
+    if (sortBy == SEGREGATED || sortBy == TLSF) {
+        metadata_t* found = sortBy == TLSF ? findInTLSF(need) : findInBins(need);
+        return found != NULL ? getMemoryFromBins(size) : NULL;
+    }
+    if (sortBy == ADDRESS) {
+        metadata_t* found = findBestFitInTree(need < TREE_MIN_SIZE ? TREE_MIN_SIZE : need);
+        return found != NULL ? getMemory(size) : NULL;
+    }
+#endif
+    for (metadata_t* index = freelist; index != NULL; index = index->next) {
+        if ((size_t) GET_SIZE(index) >= need) {
+            return getMemory(size);
+        }
+    }
+    return NULL;
+}
+
+/*
+Allocates a region chunk of size bytes out of the calling thread's home arena, as a heap block that skips the mmap threshold and the thread cache. The block comes from whatever order the arena is in.
+*/
+void* allocChunk(size_t size) {
+    useHomeArena();
+    LOCK_HEAP();
+#ifdef THREAD_SAFE
+    drainRemoteFrees();
+#endif
+    void* ret = getMemoryFromArena(size);
+    UNLOCK_HEAP();
+    return ret;
+}
+
+/*
+Frees a region chunk from allocChunk back to the arena it came from.
+*/
+void freeChunk(void* ptr) {
+    useArenaOf(HEADER_OF(ptr));
+    LOCK_HEAP();
+    metadata_t* addThis = coalesceLeftAndRight(ptr);
+    addToFreeList(addThis);
+    UNLOCK_HEAP();
+}
+
+/*
+Allocates size bytes the way my_malloc_* would, but from the calling thread's home arena in whatever order it is in, for my_realloc to move a block into.
+
+Postconditions:
+- pointer to the start of the user's memory is returned and ERRNO is NO_ERROR, or NULL as for getMemoryFromArena
+*/
+void* allocBlock(size_t size) {
+    if (size > mmapThreshold) {
+        return mapLarge(size);
+    }
+#ifdef SLAB
+    if (size <= slabThreshold) {
+        void* slot = allocSlot(size);
+        if (slot != NULL) {
+            ERRNO = NO_ERROR;
+            return slot;
+        }
+    }
+#endif
+    void* ret = allocChunk(size);
+    if (ret != NULL) {
+        ERRNO = NO_ERROR;
+    }
+    return ret;
+}
+
+/* Frees ptr, wherever it came from, into its arena in whatever order the arena is in. */
+void freeBlock(void* ptr) {
+#ifdef SLAB
+    if (freeSlot(ptr)) {
+        return;
+    }
+#endif
+    metadata_t* head = HEADER_OF(ptr);
+    metadata_t peek = peekHeader(head);
+    if (IS_MMAPPED(&peek)) {
+        unmapLarge(head);
+        return;
+    }
+    freeChunk(ptr);
+}
+
+/*
+Resizes in-use block blk to need bytes without moving it. To grow, blk takes in the block to its right, if that one is free and the two together are big enough. Whatever is then left past need goes back to the freelist, merged with its right neighbor, if it is at least SPLIT_MIN for the current order.
+
+Preconditions:
+- the arena's lock is held
+- need is what getBlockSize gives for the new size
+Postconditions:
+- returns 1 if blk now fits need, or 0 if it could not grow and is as it was
+*/
+int resizeInPlace(metadata_t* blk, size_t need) {
+    size_t blkSize = GET_SIZE(blk);
+    if (need > blkSize) {
+        metadata_t* right = findRightBlk(blk);
+        if (right == NULL || IS_IN_USE(right) || blkSize + GET_SIZE(right) < need || !CAN_MERGE(blk, right)) {
+            return 0;
+        }
+        removeFromFreelist(right);
+        blkSize += GET_SIZE(right);
+        SET_SIZE(blk, blkSize);
+    }
+    if (blkSize >= need + SPLIT_MIN(sortBy)) {
+        /* The tail is made an in-use block of its own and then freed, so
+        it goes through the same merging and trimming as any other. */
+        metadata_t* tail = BLOCK_AFTER(blk, need);
+        SET_SIZE(blk, need);
+        SET_SIZE(tail, blkSize - need);
+        SET_IN_USE(tail, 1);
+        tail->next = NULL;
+        tail->prev = NULL;
+#ifdef BOUNDARY_TAGS
+        setFooter(blk);
+        setFooter(tail);
+#endif
+        addToFreeList(coalesceLeftAndRight(USER_PTR(tail)));
+    }
+#ifdef BOUNDARY_TAGS
+    setFooter(blk);
+#endif
+    return 1;
+}
+
+/*
+Moves the have usable bytes at ptr to a new block of size bytes from allocBlock and frees ptr.
+
+Postconditions:
+- returns the new block, or NULL with ptr untouched if there was none
+*/
+void* moveBlock(void* ptr, size_t have, size_t size) {
+    void* ret = allocBlock(size);
+    if (ret == NULL) {
+        return NULL;
+    }
+    memcpy(ret, ptr, have < size ? have : size);
+    freeBlock(ptr);
+    ERRNO = NO_ERROR;
+    return ret;
+}
+
+/*
+Zeroes whatever of the size bytes at ptr may not be zero already. ptr is a block ending at blkEnd, just allocated from a heap whose break had never been past untouched before. What lies past untouched came zeroed from my_sbrk and was never handed out, so the only things written there since are what extendHeap and addToFreeList put where the heap grew from, and the footer at the end of the free block the user's block came from.
+*/
+void clearBlock(char* ptr, size_t size, char* blkEnd, char* untouched) {
+    char* end = ptr + size;
+    char* dirty = untouched != NULL ? untouched + GROWTH_BOOKKEEPING : end;
+    if (dirty > ptr) {
+        memset(ptr, 0, (dirty < end ? dirty : end) - ptr);
+    }
+#ifdef BOUNDARY_TAGS
+    char* footer = blkEnd - sizeof(footer_t);
+    if (footer < ptr) {
+        footer = ptr;
+    }
+    if (footer < end) {
+        memset(footer, 0, end - footer);
+    }
+#else
+    (void) blkEnd;
+#endif
+}
+
+/* Orders two pointers by address, for qsort. */
+int compareAddresses(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t) *(void* const*) a;
+    uintptr_t y = (uintptr_t) *(void* const*) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Points arena at the calling thread's home arena, handing it one first if it has none yet. */
+void useHomeArena() {
+#ifdef THREAD_SAFE
+    if (homeArena == NULL) {
+        pthread_once(&arenaOnce, initArenas);
+        homeArena = &arenas[__atomic_fetch_add(&nextArena, 1, __ATOMIC_RELAXED) % arenaCount];
+    }
+    arena = homeArena;
+#else
+    arena = &arenas[0];
+#endif
+}
+
+/* Points arena at the arena blk was allocated from. */
+void useArenaOf(metadata_t* blk) {
+#ifdef THREAD_SAFE
+    int owner = arenaIndexOf(blk);
+    arena = &arenas[owner >= 0 ? owner : 0];
+#else
+    (void) blk;
+    arena = &arenas[0];
+#endif
+}
+
+#ifdef THREAD_SAFE
+/* Returns the index of the arena whose heap blk is in, or -1 if it is in none. With SIDE_METADATA blk is an entry in its arena's side table, so the tables are searched instead, the current arena's first. */
+int arenaIndexOf(metadata_t* blk) {
+#ifdef SIDE_METADATA
+    if (arena->index >= 0 && arena->sideTable != NULL && blk >= arena->sideTable && blk < arena->sideTable + arena->sideLen) {
+        return arena->index;
+    }
+    for (int i = 0; i < MAX_ARENAS; i++) {
+        metadata_t* table = __atomic_load_n(&arenas[i].sideTable, __ATOMIC_ACQUIRE);
+        if (table != NULL && blk >= table && blk < table + arenas[i].sideLen) {
+            return i;
+        }
+    }
+    return -1;
+#else
+    return my_sbrk_owner(blk);
+#endif
+}
+
+/* Sets up every arena's lock and list, and picks how many arenas threads are spread over unless ARENA_COUNT already did. Runs once, when the first thread allocates. */
+void initArenas() {
+    for (int i = 0; i < MAX_ARENAS; i++) {
+        arena_t* a = &arenas[i];
+        if (i != 0) {
+            a->head = &a->list;
+        }
+        a->index = i;
+        pthread_mutex_init(&a->lock, NULL);
+    }
+    if (arenaCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        arenaCount = cores < 1 ? 1 : cores > MAX_ARENAS ? MAX_ARENAS : (size_t) cores;
+    }
+}
+
+/*
+Pushes the chain of blocks from first to last, linked through next, onto the arena's remoteFrees without taking its lock.
+
+Preconditions:
+- the blocks are in use, owned by the caller and not cached
+- arena is the arena the blocks belong to
+*/
+void deferFree(metadata_t* first, metadata_t* last) {
+    metadata_t* top = __atomic_load_n(&remoteFrees, __ATOMIC_RELAXED);
+    do {
+        last->next = top;
+    } while (!__atomic_compare_exchange_n(&remoteFrees, &top, first, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+Frees everything other threads left on remoteFrees into the current order's free structures.
+
+Preconditions:
+- the arena's lock is held
+*/
+void drainRemoteFrees() {
+    metadata_t* blk = __atomic_exchange_n(&remoteFrees, NULL, __ATOMIC_ACQUIRE);
+    while (blk != NULL) {
+        metadata_t* next = blk->next;
+        addToFreeList(coalesceLeftAndRight(USER_PTR(blk)));
+        blk = next;
+    }
+}
+#endif
+
+/*
+Returns the first free block of at least need bytes from rover on, wrapping around to the start of the freelist once, or NULL if none fits.
+
+Preconditions:
+- freelist is not NULL and in address order
+*/
+metadata_t* findNextFit(size_t need) {
+    metadata_t* start = rover != NULL ? rover : freelist;
+    metadata_t* index = start;
+    do {
+        if ((size_t) GET_SIZE(index) >= need) {
+            return index;
+        }
+        index = index->next != NULL ? index->next : freelist;
+    } while (index != start);
+    return NULL;
+}
+
+/*
+Returns the first free block of at least need bytes with no more than goodFitSlack percent to spare, or else the smallest of the first goodFitCount blocks that fit, or NULL if none fits.
+*/
+metadata_t* findGoodFit(size_t need) {
+    size_t goodEnough = need + need * goodFitSlack / 100;
+    metadata_t* best = NULL;
+    size_t seen = 0;
+    for (metadata_t* index = freelist; index != NULL && seen < goodFitCount; index = index->next) {
+        size_t blkSize = GET_SIZE(index);
+        if (blkSize < need) {
+            continue;
+        }
+        if (blkSize <= goodEnough) {
+            return index;
+        }
+        if (best == NULL || blkSize < (size_t) GET_SIZE(best)) {
+            best = index;
+        }
+        seen++;
+    }
+    return best;
+}
+
+/*
+Takes free block blk off the freelist and hands need bytes of it to the user, splitting off what is left if that is big enough to be a block. If rover was on blk it moves on to the leftover.
+
+Postconditions:
+- pointer to the start of the user's memory is returned
+*/
+void* takeFreeBlock(metadata_t* blk, size_t need) {
+    int roving = rover == blk;
+    removeFromFreelist(blk);
+    if ((size_t) GET_SIZE(blk) >= need + MIN_BLOCK_SIZE) {
+        metadata_t* leftover = BLOCK_AFTER(blk, need);
+        SET_SIZE(leftover, GET_SIZE(blk) - need);
+        leftover->next = NULL;
+        leftover->prev = NULL;
+        SET_SIZE(blk, need);
+        addToFreeList(leftover);
+        if (roving) {
+            rover = leftover;
+        }
+    }
+    SET_IN_USE(blk, 1);
+#ifdef BOUNDARY_TAGS
+    setFooter(blk);
+#endif
+    return USER_PTR(blk);
+}
+
+/*
+Hands out a block from the arena's fast lists for a request of size bytes. The head of the request's own class is used if it is big enough, otherwise the head of the next class up, which always is.
+
+Preconditions:
+- the arena's lock is held
+Postconditions:
+- returns the user's memory, or NULL if the request has to come from the heap
+*/
+void* takeFromFastbin(size_t size) {
+    if (fastCount == 0) {
+        return NULL;
+    }
+    if (size > fastbinMax) {
+        return NULL;
+    }
+    size_t need = getBlockSize(size);
+    int i = need / FASTBIN_STEP;
+    metadata_t* blk = fastbins[i];
+    if (blk == NULL || (size_t) GET_SIZE(blk) < need) {
+        i++;
+        blk = fastbins[i];
+        if (blk == NULL) {
+            return NULL;
+        }
+    }
+    fastbins[i] = blk->next;
+    fastCount--;
+    return USER_PTR(blk);
+}
+
+/*
+Puts blk on the arena's fast list for its size instead of freeing it, if it is small enough and fast lists are on. Reaching FASTBIN_CONSOLIDATE blocks merges them all back into the heap.
+
+Preconditions:
+- the arena's lock is held and blk is in use
+Postconditions:
+- returns 1 if blk is now on a fast list, 0 if it still needs freeing
+*/
+int putInFastbin(metadata_t* blk) {
+    if (fastbinMax == 0 || (size_t) GET_SIZE(blk) > getBlockSize(fastbinMax)) {
+        return 0;
+    }
+    int i = GET_SIZE(blk) / FASTBIN_STEP;
+    blk->next = fastbins[i];
+    fastbins[i] = blk;
+    fastCount++;
+    if (fastCount >= FASTBIN_CONSOLIDATE) {
+        consolidateFastbins();
+    }
+    return 1;
+}
+
+/*
+Frees every block on the arena's fast lists for real, merging each with its free neighbors.
+
+Preconditions:
+- the arena's lock is held
+*/
+void consolidateFastbins() {
+    for (int i = 0; fastCount != 0 && i < FASTBIN_CLASSES; i++) {
+        while (fastbins[i] != NULL) {
+            metadata_t* blk = fastbins[i];
+            fastbins[i] = blk->next;
+            fastCount--;
+            addToFreeList(coalesceLeftAndRight(USER_PTR(blk)));
+        }
+    }
+}
+
+#ifdef SLAB
+/* Maps slabPool, rounded up to start on a SLAB_SIZE boundary. If the mapping fails slabPool stays NULL and small requests keep coming from the heap. */
+void mapSlabPool() {
+    char* pool = (char*) my_mmap(SLAB_POOL_SIZE + SLAB_SIZE);
+    if (pool != NULL) {
+        __atomic_store_n(&slabPool, (char*) ROUND_UP((uintptr_t) pool, SLAB_SIZE), __ATOMIC_RELEASE);
+    }
+}
+
+/*
+Sets up a new empty slab for size class c of the current arena, reusing a slab some arena gave up if there is one.
+
+Postconditions:
+- returns NULL if slabPool is used up or could not be mapped
+*/
+slab_t* newSlab(int c) {
+#ifdef THREAD_SAFE
+    pthread_once(&slabOnce, mapSlabPool);
+    pthread_mutex_lock(&slabPoolLock);
+#else
+    if (slabPool == NULL) {
+        mapSlabPool();
+    }
+#endif
+    slab_t* slab = freeSlabs;
+    if (slab != NULL) {
+        freeSlabs = slab->next;
+    } else if (slabPool != NULL && slabPoolTop < SLAB_POOL_SIZE) {
+        slab = (slab_t*) (slabPool + slabPoolTop);
+        slabPoolTop += SLAB_SIZE;
+    }
+#ifdef THREAD_SAFE
+    pthread_mutex_unlock(&slabPoolLock);
+#endif
+    if (slab == NULL) {
+        return NULL;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->freeSlots = NULL;
+    slab->size = (c + 1) * SLAB_STEP;
+    slab->count = (SLAB_SIZE - SLAB_HEADER) / slab->size;
+    slab->used = 0;
+    slab->fresh = 0;
+    slab->arena = arena->index;
+    return slab;
+}
+
+/* Takes slab off the list of its class that has slots to give. */
+void unlinkSlab(slab_t* slab) {
+    int c = slab->size / SLAB_STEP - 1;
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        slabs[c] = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/*
+Hands out a slot for a request of size bytes from a slab of the calling thread's home arena.
+
+Preconditions:
+- size is at most SLAB_MAX_SIZE
+Postconditions:
+- returns NULL if no slab could be had, and the request should come from the heap instead
+*/
+void* allocSlot(size_t size) {
+    int c = size == 0 ? 0 : (size - 1) / SLAB_STEP;
+    useHomeArena();
+    LOCK_HEAP();
+    slab_t* slab = slabs[c];
+    if (slab == NULL) {
+        slab = newSlab(c);
+        if (slab == NULL) {
+            UNLOCK_HEAP();
+            return NULL;
+        }
+        slabs[c] = slab;
+    }
+    void* slot = slab->freeSlots;
+    if (slot != NULL) {
+        slab->freeSlots = *(void**) slot;
+    } else {
+        slot = ((char*) slab) + SLAB_HEADER + slab->fresh * slab->size;
+        slab->fresh++;
+    }
+    slab->used++;
+    /* A full slab only goes back on the list once a slot is freed. */
+    if (slab->freeSlots == NULL && slab->fresh == slab->count) {
+        unlinkSlab(slab);
+    }
+    UNLOCK_HEAP();
+    return slot;
+}
+
+/* Returns the slab ptr is a slot of, or NULL if it is not in slabPool. */
+slab_t* slabOf(void* ptr) {
+    char* pool = __atomic_load_n(&slabPool, __ATOMIC_ACQUIRE);
+    if (pool == NULL || (char*) ptr < pool || (char*) ptr >= pool + SLAB_POOL_SIZE) {
+        return NULL;
+    }
+    return (slab_t*) ((uintptr_t) ptr & ~((uintptr_t) SLAB_SIZE - 1));
+}
+
+/*
+Gives ptr back to its slab, if it is a slot at all.
+
+Postconditions:
+- returns 1 if ptr was a slot, 0 if it is not in slabPool and still needs freeing
+*/
+int freeSlot(void* ptr) {
+    slab_t* slab = slabOf(ptr);
+    if (slab == NULL) {
+        return 0;
+    }
+    arena = &arenas[slab->arena];
+    LOCK_HEAP();
+    int c = slab->size / SLAB_STEP - 1;
+    int wasFull = slab->freeSlots == NULL && slab->fresh == slab->count;
+    *(void**) ptr = slab->freeSlots;
+    slab->freeSlots = ptr;
+    slab->used--;
+    if (wasFull) {
+        slab->next = slabs[c];
+        if (slabs[c] != NULL) {
+            slabs[c]->prev = slab;
+        }
+        slabs[c] = slab;
+    } else if (slab->used == 0 && (slab->prev != NULL || slab->next != NULL)) {
+        unlinkSlab(slab);
+#ifdef THREAD_SAFE
+        pthread_mutex_lock(&slabPoolLock);
+#endif
+        slab->next = freeSlabs;
+        freeSlabs = slab;
+#ifdef THREAD_SAFE
+        pthread_mutex_unlock(&slabPoolLock);
+#endif
+    }
+    UNLOCK_HEAP();
+    return 1;
+}
+#endif
+
+#ifdef THREAD_CACHE
+/* Creates tcacheKey, the first time any thread caches a block. */
+void makeCacheKey() {
+    pthread_key_create(&tcacheKey, releaseCache);
+}
+
+/*
+Hands out a block from the calling thread's cache for a request of size bytes, without taking the lock. The head of the request's own class is used if it is big enough, otherwise the head of the next class up, which always is.
+
+Postconditions:
+- pointer to the start of the user's memory is returned, or NULL if neither class has a block that fits
+*/
+void* takeFromCache(size_t size) {
+    size_t need = getBlockSize(size);
+    for (size_t i = need / TCACHE_STEP; i <= need / TCACHE_STEP + 1 && i < TCACHE_CLASSES; i++) {
+        metadata_t* blk = tcache[i];
+        if (blk != NULL) {
+            metadata_t head = peekHeader(blk);
+            if ((size_t) GET_SIZE(&head) >= need) {
+                tcache[i] = blk->next;
+                tcacheLen[i]--;
+#ifdef SIDE_METADATA
+                /* Where blk starts is kept by the arena it came from. */
+                useArenaOf(blk);
+#endif
+                return USER_PTR(blk);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+Keeps blk in the calling thread's cache instead of freeing it, if it is small enough and caching is on. A full class first gives half of itself back to the heap.
+
+Preconditions:
+- blk is in use and owned by the caller
+Postconditions:
+- returns 1 if blk is now cached, 0 if it still needs freeing
+*/
+int putInCache(metadata_t* blk) {
+    metadata_t head = peekHeader(blk);
+    if (tcacheCount == 0 || IS_MMAPPED(&head) || (size_t) GET_SIZE(&head) >= TCACHE_MAX_SIZE) {
+        return 0;
+    }
+    if (!tcacheRegistered) {
+        /* Any non-NULL value makes the destructor run when the thread exits. */
+        pthread_once(&tcacheOnce, makeCacheKey);
+        pthread_setspecific(tcacheKey, &tcacheRegistered);
+        tcacheRegistered = 1;
+    }
+    int i = GET_SIZE(&head) / TCACHE_STEP;
+    if (tcacheLen[i] >= tcacheCount) {
+        flushCache(i, tcacheCount / 2);
+    }
+    blk->next = tcache[i];
+    tcache[i] = blk;
+    tcacheLen[i]++;
+    return 1;
+}
+
+/*
+Tops up the calling thread's cache after a miss, so that the next few requests of the same size do not need the lock. Up to half of tcacheCount extra blocks are allocated, stopping early rather than growing the heap. A block that would not fit in one of the two classes takeFromCache looks in for this size, or in a full one, goes back instead.
+
+Preconditions:
+- the arena's lock is held and sortBy is already set for the request
+*/
+void fillCache(size_t size) {
+    size_t need = getBlockSize(size);
+    if (tcacheCount == 0 || need >= TCACHE_MAX_SIZE) {
+        return;
+    }
+    for (size_t n = tcacheCount / 2; n > 0 && tcacheLen[need / TCACHE_STEP] < tcacheCount; n--) {
+        void* ptr = getMemoryByOrder(size);
+        if (ptr == NULL) {
+            break;
+        }
+        metadata_t* blk = HEAP_HEADER(ptr);
+        size_t i = GET_SIZE(blk) / TCACHE_STEP;
+        if (i > need / TCACHE_STEP + 1 || i >= TCACHE_CLASSES || tcacheLen[i] >= tcacheCount) {
+            /* Too big a leftover to split off came with it, and a request
+            this size would never take it back out of the cache. */
+            addToFreeList(coalesceLeftAndRight(ptr));
+            break;
+        }
+        blk->next = tcache[i];
+        tcache[i] = blk;
+        tcacheLen[i]++;
+    }
+}
+
+/*
+Gives all but keep of the blocks in class i of the calling thread's cache back to the heap. Blocks go back in runs that belong to the same arena, each run under one lock.
+*/
+void flushCache(int i, size_t keep) {
+    while (tcacheLen[i] > keep) {
+        metadata_t* first = tcache[i];
+        metadata_t* last = first;
+        size_t n = 1;
+        useArenaOf(first);
+        int owner = arena->index;
+        while (tcacheLen[i] - n > keep && arenaIndexOf(last->next) == owner) {
+            last = last->next;
+            n++;
+        }
+        tcache[i] = last->next;
+        tcacheLen[i] -= n;
+        last->next = NULL;
+        /* If another thread has the arena, the run goes on its remote free
+        list in one go instead. */
+        if (pthread_mutex_trylock(&arena->lock) != 0) {
+            deferFree(first, last);
+            continue;
+        }
+        while (first != NULL) {
+            metadata_t* blk = first;
+            first = blk->next;
+            metadata_t* addThis = coalesceLeftAndRight(USER_PTR(blk));
+            addToFreeList(addThis);
+        }
+        UNLOCK_HEAP();
+    }
+}
+
+/* Gives the calling thread's whole cache back to the heap. This is the destructor of tcacheKey, so it runs when a thread that cached anything exits. */
+void releaseCache(void* unused) {
+    (void) unused;
+    for (int i = 0; i < TCACHE_CLASSES; i++) {
+        if (tcacheLen[i] != 0) {
+            flushCache(i, 0);
+        }
+    }
+}
+
+#endif
+
+#ifdef BOUNDARY_TAGS
+void* my_malloc_segregated(size_t size)
+{
+    return mallocInOrder(SEGREGATED, size);
+}
+
+void my_free_segregated(void* ptr)
+{
+    freeInOrder(SEGREGATED, ptr);
+}
+
+void* my_malloc_tlsf(size_t size)
+{
+    return mallocInOrder(TLSF, size);
+}
+
+void my_free_tlsf(void* ptr)
+{
+    freeInOrder(TLSF, ptr);
+}
+
+/*
+Segregated fit version of getMemory, used for both the SEGREGATED and TLSF orderings. Small requests are rounded up to a multiple of BIN_STEP so they always match a size class exactly, then findInBins or findInTLSF picks the block.
+If nothing fits, the block extendHeap makes is always big enough, so it is used as is.
+
+Postconditions:
+- pointer to the start of the user's memory is returned, or NULL with OUT_OF_MEMORY set
+- the block's leftover, if big enough to be its own block, is back in its bin
+*/
+void* getMemoryFromBins(size_t size) {
+    size_t need = getBlockSize(size);
+    if (need < SMALL_BIN_LIMIT) {
+        need = (need + BIN_STEP - 1) & ~((size_t) BIN_STEP - 1);
+    }
+
+    metadata_t* found;
+    if (sortBy == TLSF) {
+        found = findInTLSF(need);
+    } else {
+        found = findInBins(need);
+    }
+    if (found != NULL) {
+        removeFromFreelist(found);
+    } else {
+        found = extendHeap(need);
+        if (found == NULL) {
+            return NULL;
+        }
+    }
+
+    /* Split off the leftover if it can stand as a block of its own,
+    otherwise the user just gets the whole block. */
+    if ((size_t) GET_SIZE(found) >= need + MIN_BLOCK_SIZE + BIN_STEP) {
+        metadata_t* leftover = BLOCK_AFTER(found, need);
+        SET_SIZE(leftover, GET_SIZE(found) - need);
+        leftover->next = NULL;
+        leftover->prev = NULL;
+        SET_SIZE(found, need);
+        addToFreeList(leftover);
+    }
+    SET_IN_USE(found, 1);
+    setFooter(found);
+    return USER_PTR(found);
+}
+
+/*
+Finds a free block of at least need bytes in the segregated bins, or returns NULL.
+Small bins hold exactly one size class, so a small request takes the head of its own bin without looking at it. A large request looks through its own logarithmic bin for a first fit. Failing that, the head of the first non-empty bin above the request's own is always big enough.
+*/
+metadata_t* findInBins(size_t need) {
+    int bin = getBinIndex(need);
+    metadata_t* found = NULL;
+    if (bin >= SMALL_BIN_COUNT) {
+        for (metadata_t* index = bins[bin]; index != NULL; index = index->next) {
+            if ((size_t) GET_SIZE(index) >= need) {
+                found = index;
+                break;
+            }
+        }
+    } else {
+        found = bins[bin];
+    }
+    for (int i = bin + 1; found == NULL && i < NUM_BINS; i++) {
+        found = bins[i];
+    }
+    return found;
+}
+
+/*
+Returns which bin a block of the given size (metadata included) lives in.
+Sizes under SMALL_BIN_LIMIT get one bin per BIN_STEP bytes. Everything else gets one bin per power of two, with the last bin taking anything too big for the others.
+*/
+int getBinIndex(size_t size) {
+    if (size < SMALL_BIN_LIMIT) {
+        return size / BIN_STEP;
+    }
+    int log = 0;
+    while ((size >> log) > 1) {
+        log++;
+    }
+    int bin = SMALL_BIN_COUNT + log - SMALL_BIN_LIMIT_LOG;
+    if (bin >= NUM_BINS) {
+        bin = NUM_BINS - 1;
+    }
+    return bin;
+}
+
+/*
+Pushes addThis onto the front of its bin. Bins are not kept in any order, small bins do not need one and large bins are searched first fit.
+
+Preconditions:
+- addThis is free and has ALREADY attempted to coalesce with neighbors
+*/
+void addToBin(metadata_t* addThis) {
+    int bin = getBinIndex(GET_SIZE(addThis));
+    addThis->prev = NULL;
+    addThis->next = bins[bin];
+    if (bins[bin] != NULL) {
+        bins[bin]->prev = addThis;
+    }
+    bins[bin] = addThis;
+}
+
+/*
+Unlinks index from its bin.
+
+Preconditions:
+- index's size has not changed since it was added to its bin
+*/
+void removeFromBin(metadata_t* index) {
+    if (index->prev == NULL) {
+        bins[getBinIndex(GET_SIZE(index))] = index->next;
+    } else {
+        index->prev->next = index->next;
+    }
+    if (index->next != NULL) {
+        index->next->prev = index->prev;
+    }
+    index->next = NULL;
+    index->prev = NULL;
+}
+
+/*
+Works out the first and second level TLSF indexes of a block of the given size (metadata included).
+Sizes under TLSF_SMALL_LIMIT all live in first level 0, split into TLSF_SL_COUNT lists of BIN_STEP bytes each. Past that, the first level is the power of two the size falls in and the second level is which of the TLSF_SL_COUNT equal slices of that power of two it falls in.
+*/
+void mapTLSF(size_t size, int* fl, int* sl) {
+    if (size < TLSF_SMALL_LIMIT) {
+        *fl = 0;
+        *sl = size / BIN_STEP;
+        return;
+    }
+    int log = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size);
+    *fl = log - TLSF_SMALL_LIMIT_LOG + 1;
+    *sl = (size >> (log - TLSF_SL_LOG)) ^ TLSF_SL_COUNT;
+    if (*fl >= TLSF_FL_COUNT) {
+        *fl = TLSF_FL_COUNT - 1;
+        *sl = TLSF_SL_COUNT - 1;
+    }
+}
+
+/*
+Finds a free block of at least need bytes in the TLSF lists, or returns NULL, without any loops.
+need is first rounded up to the next second level boundary so that any block in the list it maps to is big enough. Then the second level bitmap of that first level says if there is a big enough list there, and if not, the first level bitmap says which larger first level has anything at all. Either way the head of the list is taken as is.
+*/
+metadata_t* findInTLSF(size_t need) {
+    if (need >= TLSF_SMALL_LIMIT) {
+        int log = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(need);
+        need += ((size_t) 1 << (log - TLSF_SL_LOG)) - 1;
+    }
+    int fl;
+    int sl;
+    mapTLSF(need, &fl, &sl);
+
+    unsigned int slMap = tlsfSlBitmap[fl] & (~0U << sl);
+    if (slMap == 0) {
+        unsigned int flMap = (fl + 1 < TLSF_FL_COUNT) ? tlsfFlBitmap & (~0U << (fl + 1)) : 0;
+        if (flMap == 0) {
+            return NULL;
+        }
+        fl = __builtin_ctz(flMap);
+        slMap = tlsfSlBitmap[fl];
+    }
+    sl = __builtin_ctz(slMap);
+    return tlsfLists[fl][sl];
+}
+
+/*
+Pushes addThis onto the front of its TLSF list and marks that list and its first level as non-empty in the bitmaps.
+
+Preconditions:
+- addThis is free and has ALREADY attempted to coalesce with neighbors
+*/
+void addToTLSF(metadata_t* addThis) {
+    int fl;
+    int sl;
+    mapTLSF(GET_SIZE(addThis), &fl, &sl);
+    addThis->prev = NULL;
+    addThis->next = tlsfLists[fl][sl];
+    if (tlsfLists[fl][sl] != NULL) {
+        tlsfLists[fl][sl]->prev = addThis;
+    }
+    tlsfLists[fl][sl] = addThis;
+    tlsfSlBitmap[fl] |= 1U << sl;
+    tlsfFlBitmap |= 1U << fl;
+}
+
+/*
+Unlinks index from its TLSF list, clearing the bitmap bits of anything that is now empty.
+
+Preconditions:
+- index's size has not changed since it was added to its list
+*/
+void removeFromTLSF(metadata_t* index) {
+    int fl;
+    int sl;
+    mapTLSF(GET_SIZE(index), &fl, &sl);
+    if (index->prev == NULL) {
+        tlsfLists[fl][sl] = index->next;
+        if (index->next == NULL) {
+            tlsfSlBitmap[fl] &= ~(1U << sl);
+            if (tlsfSlBitmap[fl] == 0) {
+                tlsfFlBitmap &= ~(1U << fl);
+            }
+        }
+    } else {
+        index->prev->next = index->next;
+    }
+    if (index->next != NULL) {
+        index->next->prev = index->prev;
+    }
+    index->next = NULL;
+    index->prev = NULL;
+}
+
+/* Returns how tall the given tree is under n, with an empty tree being 0. */
+static int treeHeight(metadata_t* n, int tree) {
+    return n == NULL ? 0 : TREE_NODE(n)->height[tree];
+}
+
+/* Orders two blocks within the given tree. */
+static int treeLess(metadata_t* a, metadata_t* b, int tree) {
+    if (tree == SIZE_TREE && GET_SIZE(a) != GET_SIZE(b)) {
+        return GET_SIZE(a) < GET_SIZE(b);
+    }
+    return a < b;
+}
+
+/* Recomputes n's height, and for the address tree its largest block, from its children. */
+static void updateTreeNode(metadata_t* n, int tree) {
+    treenode_t* node = TREE_NODE(n);
+    int leftHeight = treeHeight(node->left[tree], tree);
+    int rightHeight = treeHeight(node->right[tree], tree);
+    node->height[tree] = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    if (tree == ADDR_TREE) {
+        node->maxSize = GET_SIZE(n);
+        if (node->left[tree] != NULL && TREE_NODE(node->left[tree])->maxSize > node->maxSize) {
+            node->maxSize = TREE_NODE(node->left[tree])->maxSize;
+        }
+        if (node->right[tree] != NULL && TREE_NODE(node->right[tree])->maxSize > node->maxSize) {
+            node->maxSize = TREE_NODE(node->right[tree])->maxSize;
+        }
+    }
+}
+
+static metadata_t* rotateRight(metadata_t* n, int tree) {
+    metadata_t* left = TREE_NODE(n)->left[tree];
+    TREE_NODE(n)->left[tree] = TREE_NODE(left)->right[tree];
+    TREE_NODE(left)->right[tree] = n;
+    updateTreeNode(n, tree);
+    updateTreeNode(left, tree);
+    return left;
+}
+
+static metadata_t* rotateLeft(metadata_t* n, int tree) {
+    metadata_t* right = TREE_NODE(n)->right[tree];
+    TREE_NODE(n)->right[tree] = TREE_NODE(right)->left[tree];
+    TREE_NODE(right)->left[tree] = n;
+    updateTreeNode(n, tree);
+    updateTreeNode(right, tree);
+    return right;
+}
+
+/* Rotates n's subtree back into AVL balance if one side got two taller than the other. Returns the new top of the subtree. */
+static metadata_t* balanceTree(metadata_t* n, int tree) {
+    treenode_t* node = TREE_NODE(n);
+    updateTreeNode(n, tree);
+    int balance = treeHeight(node->left[tree], tree) - treeHeight(node->right[tree], tree);
+    if (balance > 1) {
+        metadata_t* left = node->left[tree];
+        if (treeHeight(TREE_NODE(left)->left[tree], tree) < treeHeight(TREE_NODE(left)->right[tree], tree)) {
+            node->left[tree] = rotateLeft(left, tree);
+        }
+        return rotateRight(n, tree);
+    }
+    if (balance < -1) {
+        metadata_t* right = node->right[tree];
+        if (treeHeight(TREE_NODE(right)->right[tree], tree) < treeHeight(TREE_NODE(right)->left[tree], tree)) {
+            node->right[tree] = rotateRight(right, tree);
+        }
+        return rotateLeft(n, tree);
+    }
+    return n;
+}
+
+static metadata_t* treeInsert(metadata_t* root, metadata_t* n, int tree) {
+    if (root == NULL) {
+        treenode_t* node = TREE_NODE(n);
+        node->left[tree] = NULL;
+        node->right[tree] = NULL;
+        node->height[tree] = 1;
+        if (tree == ADDR_TREE) {
+            node->maxSize = GET_SIZE(n);
+        }
+        return n;
+    }
+    if (treeLess(n, root, tree)) {
+        TREE_NODE(root)->left[tree] = treeInsert(TREE_NODE(root)->left[tree], n, tree);
+    } else {
+        TREE_NODE(root)->right[tree] = treeInsert(TREE_NODE(root)->right[tree], n, tree);
+    }
+    return balanceTree(root, tree);
+}
+
+/* Takes the leftmost block out of root's subtree and hands it back through min. */
+static metadata_t* treeRemoveMin(metadata_t* root, int tree, metadata_t** min) {
+    if (TREE_NODE(root)->left[tree] == NULL) {
+        *min = root;
+        return TREE_NODE(root)->right[tree];
+    }
+    TREE_NODE(root)->left[tree] = treeRemoveMin(TREE_NODE(root)->left[tree], tree, min);
+    return balanceTree(root, tree);
+}
+
+static metadata_t* treeRemove(metadata_t* root, metadata_t* n, int tree) {
+    if (root == NULL) {
+        return NULL;
+    }
+    if (root == n) {
+        metadata_t* left = TREE_NODE(n)->left[tree];
+        metadata_t* right = TREE_NODE(n)->right[tree];
+        if (right == NULL) {
+            return left;
+        }
+        metadata_t* min;
+        right = treeRemoveMin(right, tree, &min);
+        TREE_NODE(min)->left[tree] = left;
+        TREE_NODE(min)->right[tree] = right;
+        return balanceTree(min, tree);
+    }
+    if (treeLess(n, root, tree)) {
+        TREE_NODE(root)->left[tree] = treeRemove(TREE_NODE(root)->left[tree], n, tree);
+    } else {
+        TREE_NODE(root)->right[tree] = treeRemove(TREE_NODE(root)->right[tree], n, tree);
+    }
+    return balanceTree(root, tree);
+}
+
+/*
+Finds the smallest free block of at least need bytes, the lowest addressed one if several are that size, in O(log n). Returns NULL if nothing fits, which the largest block in the address tree answers right away.
+*/
+metadata_t* findBestFitInTree(size_t need) {
+    if (addrRoot == NULL || TREE_NODE(addrRoot)->maxSize < need) {
+        return NULL;
+    }
+    metadata_t* best = NULL;
+    metadata_t* index = sizeRoot;
+    while (index != NULL) {
+        if ((size_t) GET_SIZE(index) >= need) {
+            best = index;
+            index = TREE_NODE(index)->left[SIZE_TREE];
+        } else {
+            index = TREE_NODE(index)->right[SIZE_TREE];
+        }
+    }
+    return best;
+}
+
+/*
+Adds addThis to both trees and links it into freelist right after the block the address tree says comes before it, which keeps freelist in address order without walking it.
+Blocks too small for a treenode_t are only linked into freelist, and the short walk forward from the block before them skips any other small blocks.
+
+Preconditions:
+- addThis is free and has ALREADY attempted to coalesce with neighbors
+*/
+void addToTree(metadata_t* addThis) {
+    metadata_t* before = NULL;
+    metadata_t* index = addrRoot;
+    while (index != NULL) {
+        if (index < addThis) {
+            before = index;
+            index = TREE_NODE(index)->right[ADDR_TREE];
+        } else {
+            index = TREE_NODE(index)->left[ADDR_TREE];
+        }
+    }
+    /* Small blocks are not in the trees, so step past any sitting between
+    before and addThis in memory. */
+    metadata_t* after = before == NULL ? freelist : before->next;
+    while (after != NULL && after < addThis) {
+        before = after;
+        after = after->next;
+    }
+    addThis->prev = before;
+    addThis->next = after;
+    if (before == NULL) {
+        freelist = addThis;
+    } else {
+        before->next = addThis;
+    }
+    if (after != NULL) {
+        after->prev = addThis;
+    }
+
+    if ((size_t) GET_SIZE(addThis) >= TREE_MIN_SIZE) {
+        addrRoot = treeInsert(addrRoot, addThis, ADDR_TREE);
+        sizeRoot = treeInsert(sizeRoot, addThis, SIZE_TREE);
+    }
+}
+
+/*
+Takes index out of both trees. Unlinking it from freelist is left to removeFromFreelist.
+
+Preconditions:
+- index's size has not changed since it was added to the trees
+*/
+void removeFromTree(metadata_t* index) {
+    addrRoot = treeRemove(addrRoot, index, ADDR_TREE);
+    sizeRoot = treeRemove(sizeRoot, index, SIZE_TREE);
+}
+#endif
+
+#ifdef FREE_INDEX
+/*
+Returns the smallest of the len sizes that is at least need, or 0 if none is. Taking need off makes every size that is too small wrap around to more than INT32_MAX, so this is the minimum of size - need over all of them.
+*/
+static uint32_t indexBestFit(const uint32_t* sizes, size_t len, uint32_t need) {
+    uint32_t best = UINT32_MAX;
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i vneed = _mm256_set1_epi32((int) need);
+    __m256i vbest = _mm256_set1_epi32(-1);
+    for (; i + 8 <= len; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (sizes + i));
+        vbest = _mm256_min_epu32(vbest, _mm256_sub_epi32(v, vneed));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*) lanes, vbest);
+    for (int l = 0; l < 8; l++) {
+        if (lanes[l] < best) {
+            best = lanes[l];
+        }
+    }
+#elif defined(__SSE2__)
+    /* SSE2 only compares signed, so the sign bit of everything is flipped. */
+    __m128i bias = _mm_set1_epi32(INT32_MIN);
+    __m128i vneed = _mm_set1_epi32((int) need);
+    __m128i vbest = _mm_set1_epi32(INT32_MAX);
+    for (; i + 4 <= len; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (sizes + i));
+        v = _mm_xor_si128(_mm_sub_epi32(v, vneed), bias);
+        __m128i less = _mm_cmplt_epi32(v, vbest);
+        vbest = _mm_or_si128(_mm_and_si128(less, v), _mm_andnot_si128(less, vbest));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, _mm_xor_si128(vbest, bias));
+    for (int l = 0; l < 4; l++) {
+        if (lanes[l] < best) {
+            best = lanes[l];
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (sizes[i] - need < best) {
+            best = sizes[i] - need;
+        }
+    }
+    return best <= INT32_MAX ? need + best : 0;
+}
 
-                metadata_t* leftover = (metadata_t*) (((char*) index) + size + sizeof(metadata_t));
-                leftover->size = bestSize - (size
-                    + sizeof(metadata_t));
-                leftover->in_use = 0;
-                leftover->next = NULL;
-                leftover->prev = NULL;
+/* Returns the first place from from on where sizes holds size, or len if there is none. */
+static size_t indexFind(const uint32_t* sizes, size_t len, size_t from, uint32_t size) {
+    size_t i = from;
+#if defined(__AVX2__)
+    __m256i vsize = _mm256_set1_epi32((int) size);
+    for (; i + 8 <= len; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (sizes + i)), vsize);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i vsize = _mm_set1_epi32((int) size);
+    for (; i + 4 <= len; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (sizes + i)), vsize);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (sizes[i] == size) {
+            return i;
+        }
+    }
+    return len;
+}
 
-                addToFreeList(leftover);
-            }
-            void* ret = (void*) (((char*) index) + sizeof(metadata_t));
-            return ret;
+/* Returns the largest of the len sizes, or 0 if len is 0. */
+static uint32_t indexLargest(const uint32_t* sizes, size_t len) {
+    uint32_t best = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i vbest = _mm256_setzero_si256();
+    for (; i + 8 <= len; i += 8) {
+        vbest = _mm256_max_epu32(vbest, _mm256_loadu_si256((const __m256i*) (sizes + i)));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*) lanes, vbest);
+    for (int l = 0; l < 8; l++) {
+        if (lanes[l] > best) {
+            best = lanes[l];
+        }
+    }
+#elif defined(__SSE2__)
+    /* Sizes are at most INT32_MAX, so a signed compare is enough. */
+    __m128i vbest = _mm_setzero_si128();
+    for (; i + 4 <= len; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (sizes + i));
+        __m128i more = _mm_cmpgt_epi32(v, vbest);
+        vbest = _mm_or_si128(_mm_and_si128(more, v), _mm_andnot_si128(more, vbest));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, vbest);
+    for (int l = 0; l < 4; l++) {
+        if (lanes[l] > best) {
+            best = lanes[l];
         }
     }
+#endif
+    for (; i < len; i++) {
+        if (sizes[i] > best) {
+            best = sizes[i];
+        }
+    }
+    return best;
+}
 
-    /*
-    If we reach this point, there was not enough memory in freelist to accomodate request. We need to call my_sbrk. Conveniently, index happens to point to the end of the list, so simply set its next to the new large block.
-    */
-    metadata_t *temp = (metadata_t *) my_sbrk(SBRK_SIZE);
-    /*
-    If my_sbrk returns null, we are out of heap space. Set code
-    OUT_OF_MEMORY and return null.
-    */
-    if (temp == NULL) {
-        ERRNO = OUT_OF_MEMORY;
-        return NULL;
+/* Returns the last place before len where sizes holds size, or len if there is none. */
+static size_t indexFindLast(const uint32_t* sizes, size_t len, uint32_t size) {
+    size_t i = len;
+#if defined(__AVX2__)
+    __m256i vsize = _mm256_set1_epi32((int) size);
+    for (; i >= 8; i -= 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (sizes + i - 8)), vsize);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask != 0) {
+            return i - 8 + (31 - __builtin_clz(mask));
+        }
     }
-    temp->size = SBRK_SIZE;
-    temp->in_use = 0;
+#elif defined(__SSE2__)
+    __m128i vsize = _mm_set1_epi32((int) size);
+    for (; i >= 4; i -= 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (sizes + i - 4)), vsize);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask != 0) {
+            return i - 4 + (31 - __builtin_clz(mask));
+        }
+    }
+#endif
+    while (i > 0) {
+        i--;
+        if (sizes[i] == size) {
+            return i;
+        }
+    }
+    return len;
+}
 
-    /* Adaptation of coalesceLeftandRight to only coalesce left. */
-    metadata_t* left = findLeftBlk(temp);
-    if (left != NULL && left->in_use == 0) {
-        /* Absorb left's size into the returning size */
-        short tempSize = temp->size;
-        temp = left;
-        temp->size += tempSize;
-        /* Since you're absorbing the left, remove it from freelist */
-        removeFromFreelist(left);
+/* Returns how many blocks in the index are below blk. In address order, that is where blk is in the index, or where it goes. */
+static size_t indexPlace(metadata_t* blk) {
+    size_t lo = 0;
+    size_t hi = idxLen;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idxBlocks[mid] < blk) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
-    temp->prev = NULL;
-    temp->next = NULL;
-    addToFreeList(temp);
-    return getMemory(size); // Could be implemented with a "didSBRKHappen" boolean instead of recursion, since this will only recurse once.
+    return lo;
 }
 
 /*
-Removes index from the free list by updating previous and next references.
-Pointers in C are glorious and amazing.
+Returns the smallest free block of at least need bytes in the index, or NULL if none fits. Of the blocks that size, it is the first in the index, which is the one a walk of the freelist meets first: the one freed first in size order, and the one lowest in memory in address order.
 
 Preconditions:
-- index is pointing the the metadata, not the user's address
+- idxBroken is 0
 */
-void removeFromFreelist(metadata_t* index) {
-    if (index->prev == NULL && index->next == NULL) {
-        /* If index's prev and next are null, we know that we have
-        requested the only memory available in the freelist. Thus,
-        the freelist is now empty. */
-        freelist = NULL;
-    } else if (index->prev == NULL) {
-        /* Update the alloced memory's next block's prev to null,
-        since the alloced memory is being removed.
-        Further, if index's prev is null, we know we must be at the
-        head of the freelist. Thus, update freelist pointer. */
-        metadata_t* temp = index->next;
-        temp->prev = NULL;
-        freelist = temp;
-    } else if (index->next == NULL) {
-        /* Update the alloced memory's prev block's next to null,
-        since the alloced memory is being removed.
-        For the record, since index's next is null, we know we must
-        be at the last node of the freelist. */
-        metadata_t* temp = index->prev;
-        temp->next = NULL;
-    } else {
-        /* Join the alloced memory's prev and next blocks, since the
-        alloced memory is being removed.
-        For the record, since index has a prev and next reference,
-        we know we are inclusively inside the freelist. */
-        metadata_t* Iprev = index->prev;
-        metadata_t* Inext = index->next;
-        Iprev->next = Inext;
-        Inext->prev = Iprev;
+metadata_t* findInIndex(size_t need) {
+    uint32_t size = indexBestFit(idxSizes, idxLen, (uint32_t) need);
+    if (size == 0) {
+        return NULL;
     }
+    return idxBlocks[indexFind(idxSizes, idxLen, 0, size)];
 }
 
 /*
-Iterate through the freelist until we find a memory block whose size/address is larger than our block to add. Our block to add should be inserted TO THE LEFT of this larger block.
-This is ONLY for adding to free list and does NOT attempt to coalesce with neighbors before adding. Thus, this should only be called through other methods in my_malloc in context, not accessed directly.
+Finds where addThis goes in the freelist from the index, so that adding it reads the headers of its new neighbors and not those of every block before it. Size order puts it after the last block of its own size, the same place the walk in addToFreeList would. If there is none, it goes in front of the first block of the next size up, or at the end of the list if nothing is bigger. Address order puts it after the highest free block below it.
 
 Preconditions:
-- freelist is not NULL.
-- ptr is pointing to the metadata, not the user's address
-- ptr has ALREADY attempted to coalesce with neighbors
+- addThis is not in the index yet
 Postconditions:
-- addThis has been added to the free list in appropriate order (size or address).
+- returns 0 if the index cannot tell, which is when it is dropped or a size it needs is clamped
+- otherwise returns 1 and sets *after to the block addThis goes right after, or to NULL if it goes at the head
 */
-void addToFreeList(metadata_t* addThis) {
-    addThis->in_use = 0;
-    /* Handle if free list is empty. */
-    if (freelist == NULL) {
-        freelist = addThis;
+int findListPlace(metadata_t* addThis, metadata_t** after) {
+    if (idxBroken) {
+        return 0;
+    }
+    *after = NULL;
+    if (sortBy != SIZE) {
+        size_t at = indexPlace(addThis);
+        *after = at != 0 ? idxBlocks[at - 1] : NULL;
+        return 1;
+    }
+    /* Clamped blocks are not in the order they were added in. */
+    uint32_t size = INDEX_SIZE(addThis);
+    uint32_t next = indexBestFit(idxSizes, idxLen, size);
+    if (size == INT32_MAX || next == INT32_MAX) {
+        return 0;
+    }
+    if (next == size) {
+        *after = idxBlocks[indexFindLast(idxSizes, idxLen, size)];
+    } else if (next != 0) {
+        *after = idxBlocks[indexFind(idxSizes, idxLen, 0, next)]->prev;
+    } else if (idxLen != 0) {
+        uint32_t largest = indexLargest(idxSizes, idxLen);
+        if (largest == INT32_MAX) {
+            return 0;
+        }
+        *after = idxBlocks[indexFindLast(idxSizes, idxLen, largest)];
+    }
+    return 1;
+}
+
+/* Gives the index's mapping back and stops indexing the arena for good. */
+void dropIndex() {
+    if (idxSizes != NULL) {
+        my_munmap(idxSizes, idxCap * INDEX_ENTRY);
+    }
+    idxSizes = NULL;
+    idxBlocks = NULL;
+    idxLen = 0;
+    idxCap = 0;
+    idxBroken = 1;
+}
+
+/* Adds free block blk to the index, doubling it first if it is full. Size order appends it, address order puts it in its place by address. */
+void addToIndex(metadata_t* blk) {
+    if (idxBroken) {
         return;
     }
-    metadata_t *index = freelist;
-    int eol = 0;
-    if (sortBy == SIZE) {
-        while (!eol) {
-            if (index->size > addThis->size) {
-                /* If index's prev is null, it means we are at the start of
-                the free list (and our ptr to add is the smallest in the
-                list). Thus, update only next references references, and update freelist pointer. */
-                if (index->prev == NULL) {
-                    addThis->next = index;
-                    index->prev = addThis;
-                    freelist = addThis;
-                    return;
-                } else {
-                    /* Otherwise, we are somewhere in the middle of the free list, so update prev and next references. */
-                    metadata_t* Iprev = index->prev;
-                    addThis->prev = Iprev;
-                    Iprev->next = addThis;
-                    addThis->next = index;
-                    index->prev = addThis;
-                    return;
-                }
-            }
-            if (index->next == NULL) {
-                eol = 1;
-            } else {
-                index = index->next;
-            }
+    if (idxLen == idxCap) {
+        size_t cap = idxCap != 0 ? idxCap * 2 : INDEX_START;
+        char* map = (char*) my_mmap(cap * INDEX_ENTRY);
+        if (map == NULL) {
+            dropIndex();
+            return;
         }
-        /* If the while loop terminates, our ptr to add is the largest in the
-        free list, so add it to the end. */
-        addThis->prev = index;
-        index->next = addThis;
+        uint32_t* sizes = (uint32_t*) map;
+        metadata_t** blocks = (metadata_t**) (map + cap * sizeof(uint32_t));
+        if (idxSizes != NULL) {
+            memcpy(sizes, idxSizes, idxLen * sizeof(uint32_t));
+            memcpy(blocks, idxBlocks, idxLen * sizeof(metadata_t*));
+            my_munmap(idxSizes, idxCap * INDEX_ENTRY);
+        }
+        idxSizes = sizes;
+        idxBlocks = blocks;
+        idxCap = cap;
+    }
+    size_t at = sortBy == SIZE ? idxLen : indexPlace(blk);
+    memmove(idxSizes + at + 1, idxSizes + at, (idxLen - at) * sizeof(uint32_t));
+    memmove(idxBlocks + at + 1, idxBlocks + at, (idxLen - at) * sizeof(metadata_t*));
+    idxSizes[at] = INDEX_SIZE(blk);
+    idxBlocks[at] = blk;
+    idxLen++;
+}
+
+/*
+Takes free block blk out of the index, moving the entries after it down. In size order it is found by its size first, so blk has to still have the size it was added with.
+*/
+void removeFromIndex(metadata_t* blk) {
+    if (idxBroken) {
         return;
     }
-    if (sortBy == ADDRESS) {
-        while (!eol) {
-            if (index > addThis) {
-                /* If index's prev is null, it means we are at the start of
-                the free list (and our ptr to add is the smallest in the
-                list). Thus, update only next references, and update freelist pointer. */
-                if (index->prev == NULL) {
-                    addThis->next = index;
-                    index->prev = addThis;
-                    freelist = addThis;
-                    return;
-                } else {
-                    /* Otherwise, we are somewhere in the middle of the free list, so update prev and next references. */
-                    metadata_t* Iprev = index->prev;
-                    addThis->prev = Iprev;
-                    Iprev->next = addThis;
-                    addThis->next = index;
-                    index->prev = addThis;
-                    freelist = addThis;
-                    return;
-                }
-            }
-            if (index->next == NULL) {
-                eol = 1;
-            } else {
-                index = index->next;
-            }
+    size_t i;
+    if (sortBy == SIZE) {
+        uint32_t size = INDEX_SIZE(blk);
+        i = indexFind(idxSizes, idxLen, 0, size);
+        while (i < idxLen && idxBlocks[i] != blk) {
+            i = indexFind(idxSizes, idxLen, i + 1, size);
         }
-        /* If the while loop terminates, our ptr to add is the largest in the
-        free list, so add it to the end. */
-        addThis->prev = index;
-        index->next = addThis;
+    } else {
+        i = indexPlace(blk);
+        if (i < idxLen && idxBlocks[i] != blk) {
+            i = idxLen;
+        }
+    }
+    if (i == idxLen) {
         return;
     }
+    idxLen--;
+    memmove(idxSizes + i, idxSizes + i + 1, (idxLen - i) * sizeof(uint32_t));
+    memmove(idxBlocks + i, idxBlocks + i + 1, (idxLen - i) * sizeof(metadata_t*));
 }
 
-void my_free_size_order(void* ptr)
-{
-    if (ptr == NULL) {
-        return;
+/* Fills the index from freelist if sortBy is an indexed order, and empties it if not. */
+void rebuildIndex() {
+    idxLen = 0;
+    if (INDEXED(sortBy)) {
+        for (metadata_t* index = freelist; index != NULL; index = index->next) {
+            addToIndex(index);
+        }
     }
-    /* If ptr is not null, attempt to coalesce with neighbors then add to freelist. */
-    sortBy = SIZE;
-    metadata_t* addThis = coalesceLeftAndRight(ptr);
-    addToFreeList(addThis);
-    ERRNO = NO_ERROR;
 }
+#endif
 
-void my_free_addr_order(void* ptr)
-{
-    if (ptr == NULL) {
+/*
+Switches the allocator to a different ordering. Free blocks that were kept for the old ordering are all handed to addToFreeList again under the new one, so that mixing the size, address and segregated entry points on the same heap never loses track of free memory.
+*/
+void setOrder(enum ORDER order) {
+    if (order == sortBy) {
         return;
     }
-    /* If ptr is not null, attempt to coalesce with neighbors then add to freelist. */
-    sortBy = ADDRESS;
-    metadata_t* addThis = coalesceLeftAndRight(ptr);
-    addToFreeList(addThis);
-    ERRNO = NO_ERROR;
+    rover = NULL;
+    /* The address ordered policies share the same free structures. */
+    if (ADDRESS_ORDERED(order) && ADDRESS_ORDERED(sortBy)) {
+        sortBy = order;
+#ifdef FREE_INDEX
+        rebuildIndex();
+#endif
+        return;
+    }
+#ifdef BOUNDARY_TAGS
+    if (sortBy == SEGREGATED) {
+        /* Bins are emptied one at a time as they are re-added, nothing new
+        goes into the bins once sortBy is no longer SEGREGATED. */
+        sortBy = order;
+        for (int i = 0; i < NUM_BINS; i++) {
+            metadata_t* index = bins[i];
+            bins[i] = NULL;
+            while (index != NULL) {
+                metadata_t* next = index->next;
+                index->next = NULL;
+                index->prev = NULL;
+                addToFreeList(index);
+                index = next;
+            }
+        }
+        return;
+    }
+    if (sortBy == TLSF) {
+        sortBy = order;
+        for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+            for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+                metadata_t* index = tlsfLists[fl][sl];
+                tlsfLists[fl][sl] = NULL;
+                while (index != NULL) {
+                    metadata_t* next = index->next;
+                    index->next = NULL;
+                    index->prev = NULL;
+                    addToFreeList(index);
+                    index = next;
+                }
+            }
+            tlsfSlBitmap[fl] = 0;
+        }
+        tlsfFlBitmap = 0;
+        return;
+    }
+#endif
+    metadata_t* moving = freelist;
+    freelist = NULL;
+#ifdef FREE_INDEX
+    idxLen = 0;
+#endif
+#ifdef BOUNDARY_TAGS
+    /* The tree links of every block get overwritten as they move, only
+    freelist itself is needed to find them all. */
+    addrRoot = NULL;
+    sizeRoot = NULL;
+#endif
+    sortBy = order;
+    while (moving != NULL) {
+        metadata_t* next = moving->next;
+        moving->next = NULL;
+        moving->prev = NULL;
+        addToFreeList(moving);
+        moving = next;
+    }
 }
 
 /*
 Iterates through the freelist to find the memory block whose address is
 closest to ptr and also to the left. Returns NULL if ptr is the leftmost address, or if the left block is in_use.
 This serves as a helper function for coalesceLeftAndRight.
+
+With BOUNDARY_TAGS there is no iterating at all: the footer of the left block sits right in front of ptr, and it says whether that block is free and how far back its header is. The start fence post of each stretch of heap is an in-use footer, so the leftmost block correctly gets NULL.
 */
 metadata_t* findLeftBlk(metadata_t* ptr) {
+#ifdef BOUNDARY_TAGS
+#ifdef COMPACT_HEADER
+    if (ptr->head & PINUSE) {
+        return NULL;
+    }
+    footer_t* leftFoot = (footer_t*) (((char*) ptr) - sizeof(footer_t));
+#else
+    footer_t* leftFoot = (footer_t*) (((char*) ptr) - sizeof(footer_t));
+    if (leftFoot->in_use) {
+        return NULL;
+    }
+#endif
+    return (metadata_t*) (((char*) ptr) - leftFoot->size);
+#else
     /* Handle the case where freelist is empty */
     if (freelist == NULL) {
         return NULL;
@@ -435,7 +3465,7 @@ metadata_t* findLeftBlk(metadata_t* ptr) {
             return NULL;
         } else {
             /* Finally, test that this left block is indeed directly left of ptr. If not, then something else (in use) is between them, so return NULL. */
-            if ((metadata_t *) (((char*) index) + index->size) == ptr) {
+            if (BLOCK_AFTER(index, GET_SIZE(index)) == ptr) {
                 return index;
             } else {
                 return NULL;
@@ -466,19 +3496,28 @@ metadata_t* findLeftBlk(metadata_t* ptr) {
         return NULL;
     } else {
         /* Finally, test that this left block is indeed directly left of ptr. If not, then something else (in use) is between them, so return NULL. */
-        metadata_t* test = (metadata_t*) (((char*) left) + left->size);
+        metadata_t* test = BLOCK_AFTER(left, GET_SIZE(left));
         if (test == ptr) {
             return left;
         } else {
             return NULL;
         }
     }
+#endif
 }
 
 
 /* Iterate through the freelist to find the memory block whose address is
-closestto ptr and also to the right. Returns NULL if ptr is the rightmost address. */
+closestto ptr and also to the right. Returns NULL if ptr is the rightmost address.
+With BOUNDARY_TAGS this is just pointer arithmetic plus a look at the right block's in_use, since the end fence post of each stretch of heap reads as in use. */
 metadata_t* findRightBlk(metadata_t* ptr) {
+#ifdef BOUNDARY_TAGS
+    metadata_t* right = BLOCK_AFTER(ptr, GET_SIZE(ptr));
+    if (IS_IN_USE(right)) {
+        return NULL;
+    }
+    return right;
+#else
     /* Handle the case where freelist is empty */
     if (freelist == NULL) {
         return NULL;
@@ -498,7 +3537,7 @@ metadata_t* findRightBlk(metadata_t* ptr) {
     }
     /* Otherwise, use pointer arithmetic to reach ptr's next block. */
     /* This is primarily to make sure that adding the size does not cause us to "fall off" the far end of the freelist's available space. */
-    metadata_t* potentialRight = (metadata_t*) (((char*) ptr) + ptr->size);
+    metadata_t* potentialRight = BLOCK_AFTER(ptr, GET_SIZE(ptr));
     metadata_t* index = freelist;
     while (index != NULL) {
         if (index == potentialRight) {
@@ -507,6 +3546,7 @@ metadata_t* findRightBlk(metadata_t* ptr) {
         index = index->next;
     }
     return NULL;
+#endif
 
 
     // /* Handle the case where freelist is one block long */
@@ -551,36 +3591,134 @@ Postconditions:
 - Returned ptr points to the memory that the user uses, NOT the metadata.
  */
 metadata_t* coalesceLeftAndRight(void *ptr) {
-    metadata_t *head = (metadata_t*) ((char*) ptr - sizeof(metadata_t));
+    metadata_t *head = HEAP_HEADER(ptr);
     metadata_t *ret = head;
     metadata_t *left = findLeftBlk(ret);
     /* If there is an available left block sitting in memory, set ret to it and update ret's size to include the left block. Remove the left block from the freelist.
     Note that findLeftBlk returns NULL if left is in use, so there is really no reason to test for it here. Consistency tho. */
-    if (left != NULL && left->in_use == 0) {
+    if (left != NULL && IS_IN_USE(left) == 0 && CAN_MERGE(left, ret)) {
+        /* Since you're absorbing the left, remove it from freelist. This
+        has to happen before its size changes, since the segregated bins
+        find a block's bin from its size. */
+        removeFromFreelist(left);
         /* Absorb left's size into the returning size */
-        short retSize = ret->size;
+        size_t retSize = GET_SIZE(ret);
         ret = left;
-        ret->size += retSize;
-        /* Since you're absorbing the left, remove it from freelist */
-        removeFromFreelist(left);
+        SET_SIZE(ret, GET_SIZE(ret) + retSize);
     }
 
     metadata_t *right = findRightBlk(ret);
     /* If there is an available right block sitting in memory, update ret's size to include it. Remove the right block from the freelist. */
-    if (right != NULL && right->in_use == 0) {
-        ret->size += right->size;
+    if (right != NULL && IS_IN_USE(right) == 0 && CAN_MERGE(ret, right)) {
+        SET_SIZE(ret, GET_SIZE(ret) + GET_SIZE(right));
         removeFromFreelist(right);
     }
+#ifdef BOUNDARY_TAGS
+    setFooter(ret);
+#endif
     ret->prev = NULL;
     ret->next = NULL;
+    /* A big enough free block on top of the heap gives most of itself
+    back to my_sbrk, always keeping enough to still be a block. */
+    if ((size_t) GET_SIZE(ret) > trimThreshold) {
+        trimTop(ret, MIN_BLOCK_SIZE);
+    }
     return ret;
 }
 
-/* Returns size of freelist, used for debugging. */
+/*
+Returns the free block that runs up to the break (less the end fence), or NULL if the last block is in use or the break is not where we left it.
+*/
+metadata_t* findTopBlk() {
+#ifdef BOUNDARY_TAGS
+    if (heapEnd == NULL || (char*) arenaSbrk(0) != heapEnd) {
+        return NULL;
+    }
+    return findLeftBlk((metadata_t*) (heapEnd - END_FENCE_SIZE));
+#else
+    if (freelist == NULL) {
+        return NULL;
+    }
+    return findLeftBlk(BLOCK_AT(arenaSbrk(0)));
+#endif
+}
+
+/*
+Gives everything but the first keep bytes of blk back to my_sbrk, in whole SBRK_SIZE steps, if blk is the last block before the break. The end fence moves down to the new end of the heap. With keep of 0 blk can go away completely, otherwise whatever is left of it is still big enough to be a block.
+
+Preconditions:
+- blk is free and not on the freelist
+Postconditions:
+- returns how many bytes went back to my_sbrk, blk's size is that much smaller
+*/
+size_t trimTop(metadata_t* blk, size_t keep) {
+    size_t blkSize = GET_SIZE(blk);
+    char* end = BLOCK_MEM(blk) + blkSize;
+    if (blkSize <= keep || end + END_FENCE_SIZE != (char*) arenaSbrk(0)) {
+        return 0;
+    }
+    size_t release = (blkSize - keep) / SBRK_SIZE * SBRK_SIZE;
+    size_t left = blkSize - release;
+    if (left != 0 && left < MIN_BLOCK_SIZE) {
+        release = release >= SBRK_SIZE ? release - SBRK_SIZE : 0;
+    }
+    if (release == 0) {
+        return 0;
+    }
+#ifdef COMPACT_HEADER
+    /* If blk goes away, the fence takes its place and has to carry over
+    whether the block before it is in use. */
+    size_t fenceHead = release == blkSize ? (CINUSE | (blk->head & PINUSE)) : CINUSE;
+#endif
+    if (arenaSbrk(-(int) release) == NULL) {
+        return 0;
+    }
+    heapSize -= release;
+    /* Once all of blk is gone, it may not even be mapped any more. */
+    if (release != blkSize) {
+        SET_SIZE(blk, blkSize - release);
+    }
+#ifdef BOUNDARY_TAGS
+    heapEnd -= release;
+#ifdef COMPACT_HEADER
+    ((metadata_t*) (heapEnd - END_FENCE_SIZE))->head = fenceHead;
+#else
+    footer_t* endFence = (footer_t*) (heapEnd - END_FENCE_SIZE);
+    endFence->in_use = 1;
+    endFence->size = 0;
+#endif
+#endif
+    return release;
+}
+
+/* Returns size of freelist, used for debugging. For the segregated bins and TLSF this is the size of the first block in the highest non-empty bin. It looks at whichever arena the calling thread is using, which is left as it is. */
 short getFreelistSize() {
+#ifdef BOUNDARY_TAGS
+    if (sortBy == SEGREGATED) {
+        for (int i = NUM_BINS - 1; i >= 0; i--) {
+            if (bins[i] != NULL) {
+                return GET_SIZE(bins[i]);
+            }
+        }
+        return -1;
+    }
+    if (sortBy == TLSF) {
+        if (tlsfFlBitmap == 0) {
+            return -1;
+        }
+        int fl = (sizeof(unsigned int) * 8 - 1) - __builtin_clz(tlsfFlBitmap);
+        int sl = (sizeof(unsigned int) * 8 - 1) - __builtin_clz(tlsfSlBitmap[fl]);
+        return GET_SIZE(tlsfLists[fl][sl]);
+    }
+#endif
     if (freelist == NULL) {
         return -1;
     } else {
-        return freelist->size;
+        return GET_SIZE(freelist);
     }
 }
+
+/* Returns the current mmap threshold, used for debugging, so a test that changes it can put it back. */
+size_t getMmapThreshold() {
+    return mmapThreshold;
+}
@@ -6,6 +6,41 @@
 /* we need this for uintptr_t */
 #include <stdint.h>
 
+/* with -DTHREAD_SAFE, any number of threads may call the allocator at
+ * once. ERRNO is then kept per thread, so it always describes the
+ * calling thread's last request.
+ * -DTHREAD_CACHE also gives each thread a cache of small blocks it freed
+ * to allocate from without the lock, so it implies THREAD_SAFE.
+ */
+#ifdef THREAD_CACHE
+#ifndef THREAD_SAFE
+#define THREAD_SAFE
+#endif
+#endif
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+/* the compact header finds neighbors through its prev-in-use flag and
+ * the footers of free blocks, so it always comes with boundary tags.
+ */
+#ifdef COMPACT_HEADER
+#ifndef BOUNDARY_TAGS
+#define BOUNDARY_TAGS
+#endif
+#endif
+
+/* side metadata keeps no headers or footers in the heap at all, so it
+ * has nothing for boundary tags to work with.
+ */
+#if defined(SIDE_METADATA) && defined(BOUNDARY_TAGS)
+#error "SIDE_METADATA cannot be built with BOUNDARY_TAGS or COMPACT_HEADER"
+#endif
+
+#if !defined(COMPACT_HEADER) && !defined(SIDE_METADATA)
 /* our metadata structure for use in the freelist.
  * you *MUST NOT* change this definition unless specified
  * in an official assignment update by the TAs.
@@ -17,6 +52,133 @@ typedef struct metadata
   struct metadata* next;
   struct metadata* prev;
 } metadata_t;
+#elif defined(COMPACT_HEADER)
+/* compact metadata used when built with -DCOMPACT_HEADER. A block in use
+ * only carries head, one word holding its size with the CINUSE (this
+ * block is in use) and PINUSE (the block physically before it is in use)
+ * flags in the low bits, which are always 0 in the size since sizes are
+ * kept a multiple of 8. next and prev only exist while the block is
+ * free, in what is otherwise the start of the user's memory.
+ */
+typedef struct metadata
+{
+  size_t head;
+  struct metadata* next;
+  struct metadata* prev;
+} metadata_t;
+#else
+/* side metadata used when built with -DSIDE_METADATA. It is the one
+ * above with room for any size the heap can hold, but it lives in a
+ * table apart from the heap, one entry per SIDE_GRANULE bytes of it, and
+ * a block's metadata is the entry for the granule it starts in. Blocks
+ * are whole granules, so the user's memory is the whole block and starts
+ * on a cache line. Only blocks with a mapping of their own still keep
+ * one of these right in front of the user's memory.
+ */
+#define SIDE_GRANULE 64
+typedef struct metadata
+{
+  unsigned int in_use;
+  unsigned int size;
+  struct metadata* next;
+  struct metadata* prev;
+} metadata_t;
+#endif
+
+/* BLOCK ACCESSORS
+ *
+ * everything outside of the header definitions goes through these, so
+ * that the same code works with either metadata layout. HEADER_SIZE is
+ * how far the user's memory starts after the block's metadata.
+ * IS_MMAPPED says the block is not in the heap at all but has a mapping
+ * of its own. Such a block is always in use, and its real length is kept
+ * in the word right before its metadata since size is too small for it.
+ * SET_SIZE leaves MMAPPED clear, since heap blocks are carved out of
+ * whatever the user last wrote there.
+ * With SIDE_METADATA, HEADER_SIZE is 0 and a heap block's metadata_t* is
+ * its entry in the side table, not its address (see my_malloc.c).
+ */
+#ifdef COMPACT_HEADER
+#define CINUSE ((size_t) 1)
+#define PINUSE ((size_t) 2)
+#define MMAPPED ((size_t) 4)
+#define FLAG_BITS (CINUSE | PINUSE | MMAPPED)
+#define HEADER_SIZE sizeof(size_t)
+#define GET_SIZE(blk) ((blk)->head & ~FLAG_BITS)
+#define IS_IN_USE(blk) ((int) ((blk)->head & CINUSE))
+#define IS_MMAPPED(blk) (((blk)->head & MMAPPED) != 0)
+#define SET_SIZE(blk, s) ((blk)->head = (s) | ((blk)->head & (CINUSE | PINUSE)))
+#define SET_IN_USE(blk, u) ((blk)->head = (u) ? ((blk)->head | CINUSE) : ((blk)->head & ~CINUSE))
+#define SET_MMAPPED(blk) ((blk)->head = CINUSE | PINUSE | MMAPPED)
+#else
+#define MMAPPED 2
+#ifdef SIDE_METADATA
+#define HEADER_SIZE 0
+#else
+#define HEADER_SIZE sizeof(metadata_t)
+#endif
+#define GET_SIZE(blk) ((blk)->size)
+#define IS_IN_USE(blk) ((blk)->in_use)
+#define IS_MMAPPED(blk) ((blk)->in_use == MMAPPED)
+#define SET_SIZE(blk, s) ((blk)->size = (s))
+#define SET_IN_USE(blk, u) ((blk)->in_use = (u))
+#define SET_MMAPPED(blk) ((blk)->in_use = MMAPPED, (blk)->size = 0)
+#endif
+
+#ifdef BOUNDARY_TAGS
+#ifndef COMPACT_HEADER
+/* boundary tag written into the last bytes of every block when the
+ * allocator is built with -DBOUNDARY_TAGS. It mirrors the in_use and
+ * size fields of the block's metadata_t so that the block physically
+ * to the right can find (and size) its left neighbor without walking
+ * the freelist.
+ */
+typedef struct footer
+{
+  short in_use;
+  short size;
+} footer_t;
+#else
+/* with the compact header only free blocks have a footer, since the
+ * block to the right can tell from its own PINUSE flag whether there is
+ * a footer in front of it to read at all.
+ */
+typedef struct footer
+{
+  size_t size;
+} footer_t;
+#endif
+
+/* extra links kept in the user's part of a free block while the
+ * address ordered policy has it, so it can sit in two balanced trees at
+ * once: one ordered by address and one ordered by size (then address).
+ * The address tree also tracks the largest block under each node.
+ */
+typedef struct treenode
+{
+  struct metadata* left[2];
+  struct metadata* right[2];
+  int height[2];
+  size_t maxSize;
+} treenode_t;
+#endif
+
+#ifdef SLAB
+/* the start of a slab page, ahead of its slots. next and prev link the
+ * slabs of one size class that still have free slots.
+ */
+typedef struct slab
+{
+  struct slab* next;
+  struct slab* prev;
+  void* freeSlots;
+  unsigned short size;
+  unsigned short count;
+  unsigned short used;
+  unsigned short fresh;
+  int arena;
+} slab_t;
+#endif
 /* This is your error enum. The three
  * different types of errors for this homework are explained below.
  * If ANY function has a case where one of the errors described could
@@ -31,7 +193,7 @@ enum my_malloc_err {
 	OUT_OF_MEMORY,
 	SINGLE_REQUEST_TOO_LARGE
 };
-enum my_malloc_err ERRNO;
+extern THREAD_LOCAL enum my_malloc_err ERRNO;
 
 /* MALLOC
  *
@@ -41,6 +203,9 @@ enum my_malloc_err ERRNO;
  * space with a call to my_sbrk. if this succeeds, then you should continue
  * as normal. If it fails (by returning NULL), then you should return NULL.
  *
+ * requests over the mmap threshold (see my_mallopt) never touch the heap
+ * and get an anonymous mapping of their own instead.
+ *
  * Two versions of this function:
  *  * my_malloc_size_order uses the freelist that is sorted in increasing order of size
  *  * my_malloc_addr_order uses the freelist that is sorted in increasing order of address
@@ -52,6 +217,7 @@ void* my_malloc_addr_order(size_t);
  *
  * this function should free the block of memory, recursively merging
  * buddies up the freelist until they can be merged no more.
+ * a block that got its own mapping is simply unmapped.
  * Two versions of this function:
  *  * my_free_size_order uses the freelist that is sorted in increasing order of size
  *  * my_free_addr_order uses the freelist that is sorted in increasing order of address
@@ -59,6 +225,99 @@ void* my_malloc_addr_order(size_t);
 void my_free_size_order(void *);
 void my_free_addr_order(void *);
 
+/* NEXT FIT AND GOOD FIT
+ *
+ * two more policies over the address ordered freelist, which trade some
+ * fit for shorter searches:
+ *  * my_malloc_next_fit takes the first block that fits, starting from
+ *    where its last search stopped instead of the start of the freelist.
+ *  * my_malloc_good_fit takes the first block that fits with little to
+ *    spare (see GOOD_FIT_SLACK), or else the smallest of the first few
+ *    that fit (see GOOD_FIT_COUNT).
+ */
+void* my_malloc_next_fit(size_t);
+void my_free_next_fit(void *);
+void* my_malloc_good_fit(size_t);
+void my_free_good_fit(void *);
+
+/* REALLOC
+ *
+ * resizes a block from any of the my_malloc_* functions to hold size
+ * bytes and returns where it now is, keeping its contents up to the
+ * smaller of the two sizes. a heap block shrinks in place, giving its
+ * tail back to the freelist, and grows in place by taking in the block
+ * to its right when that one is free and big enough. only when it cannot
+ * is the block moved: a new one is allocated, the contents copied over
+ * and the old one freed, all in whatever order the heap is in. if that
+ * allocation fails, NULL is returned and ptr is left as it was.
+ * my_realloc(NULL, size) allocates, and my_realloc(ptr, 0) frees ptr and
+ * returns NULL.
+ */
+void* my_realloc(void *, size_t);
+
+/* CALLOC
+ *
+ * allocates room for nmemb objects of size bytes each, all zero, the
+ * same way my_realloc allocates. the heap only clears what has been used
+ * before: memory fresh from my_sbrk or my_mmap is zero already, so a large
+ * zeroed block costs about what touching its pages does. if nmemb * size
+ * does not fit in a size_t, ERRNO is SINGLE_REQUEST_TOO_LARGE and NULL is
+ * returned.
+ */
+void* my_calloc(size_t, size_t);
+
+/* MEMALIGN
+ *
+ * allocates size bytes starting on a multiple of alignment, which must
+ * be a power of two, the same way my_realloc allocates. the block is cut
+ * out of a bigger free one, and the slop on either side of it goes back
+ * to the freelist, so any my_free_* can free it. my_aligned_alloc is the
+ * same, except that size must also be a multiple of alignment. both
+ * return NULL for an alignment they cannot take, with ERRNO set to
+ * SINGLE_REQUEST_TOO_LARGE like any other request that can never be met.
+ */
+void* my_memalign(size_t, size_t);
+void* my_aligned_alloc(size_t, size_t);
+
+/* BATCHES
+ *
+ * my_malloc_batch allocates count blocks of size bytes into out, the same
+ * way my_realloc allocates, cutting as many as it can out of one free
+ * block under one lock. it returns how many it allocated, which is less
+ * than count only if memory ran out, with ERRNO set as for my_malloc_*.
+ * my_free_batch frees the n blocks in ptrs, which may come from any of
+ * the my_malloc_* functions and include NULLs. ptrs is sorted by address
+ * in place, so blocks next to each other are merged into one run first
+ * and the run is coalesced with its neighbors once.
+ */
+size_t my_malloc_batch(size_t, size_t, void **);
+void my_free_batch(void **, size_t);
+
+#ifdef BOUNDARY_TAGS
+/* SEGREGATED FIT
+ *
+ * a third policy that keeps free blocks in an array of per-size-class
+ * lists instead of one sorted freelist: an exact bin for every 8 bytes of
+ * small sizes and a bin per power of two above that. Small requests are
+ * served from the first non-empty bin at or above their size class.
+ * Needs -DBOUNDARY_TAGS, since coalescing cannot walk every bin to find
+ * neighbors.
+ */
+void* my_malloc_segregated(size_t);
+void my_free_segregated(void *);
+
+/* TWO LEVEL SEGREGATED FIT
+ *
+ * like the segregated policy, but the bins are split two ways (power of two,
+ * then sixteen slices of it) and two levels of bitmaps track which ones are
+ * non-empty. Finding a block is a couple of find-first-set instructions
+ * instead of a walk, so malloc and free take bounded time no matter how
+ * many free blocks there are (short of having to grow the heap).
+ */
+void* my_malloc_tlsf(size_t);
+void my_free_tlsf(void *);
+#endif
+
 
 /* this function will emulate the system call sbrk(2). if you do not
  * have enough free heap space to satisfy a memory request, then you
@@ -66,22 +325,250 @@ void my_free_addr_order(void *);
  */
 void* my_sbrk(int);
 
+/* with THREAD_SAFE the allocator can split its memory over as many as
+ * MAX_ARENAS independent heaps. my_sbrk is arena 0's break, and
+ * my_sbrk_arena moves any arena's break the same way. my_sbrk_owner says
+ * which arena's heap an address is in, or -1 if none.
+ */
+#define MAX_ARENAS 64
+void* my_sbrk_arena(int, int);
+int my_sbrk_owner(void*);
+
+/* returns the highest an arena's break has ever been. the heap past it
+ * has never been handed out, so it still reads as zero.
+ */
+void* my_sbrk_untouched(int);
+
+/* returns one past the furthest an arena's heap can ever grow to. */
+void* my_sbrk_end(int);
+
+/* my_sbrk can hand out memory two ways, picked with my_sbrk_init before
+ * the first call to my_sbrk (it returns 0 and changes nothing after):
+ *  * SBRK_EMULATED: the default, a fixed 8 KB heap per arena from calloc
+ *    that is easy to run out of on purpose, which is what the tests want.
+ *  * SBRK_RESERVED: reserves reserve bytes of address space up front (or
+ *    4 GB if reserve is 0) for each arena and only makes pages usable as
+ *    the break moves over them, so the heap can grow as big as it needs to.
+ *  * SBRK_HUGE: like SBRK_RESERVED, but each heap starts on a 2 MB boundary
+ *    and is handed out and given back in whole 2 MB pages, which the kernel
+ *    is asked to back with transparent huge pages. where it will not, the
+ *    heap still works on normal pages.
+ */
+enum SBRK_BACKEND { SBRK_EMULATED, SBRK_RESERVED, SBRK_HUGE };
+int my_sbrk_init(enum SBRK_BACKEND, size_t);
+
+/* these map and unmap anonymous memory for requests over the mmap
+ * threshold, which never come out of the my_sbrk heap. my_mmap_sparse
+ * maps tables as big as a whole heap, of which only the pages that get
+ * written ever cost memory.
+ */
+void* my_mmap(size_t);
+void* my_mmap_sparse(size_t);
+void my_munmap(void*, size_t);
+
+/* MALLOPT
+ *
+ * tunes the allocator at runtime. Returns 1 if the value was taken and 0
+ * if it is out of range for that parameter, leaving the old value.
+ *  * MMAP_THRESHOLD: requests of more than this many bytes get their own
+ *    mapping from my_mmap instead of coming out of the heap, and are
+ *    unmapped as soon as they are freed. Defaults to the largest request
+ *    one SBRK_SIZE chunk can hold, and can be no more than the largest
+ *    block the heap can grow by in one go.
+ *  * TRIM_THRESHOLD: when a free of more than this many bytes ends up at
+ *    the top of the heap, most of it goes back with a negative my_sbrk.
+ *    Defaults to 128 KB.
+ *  * GROW_POLICY: how much the heap grows by when nothing fits. With
+ *    GROW_FIXED, the default, it grows by what the request needs rounded
+ *    up to GROW_CHUNK. With GROW_GEOMETRIC it grows by at least its own
+ *    size, so it takes ever fewer my_sbrk calls to keep growing.
+ *  * GROW_CHUNK: the step GROW_FIXED rounds up to, itself rounded up to a
+ *    multiple of SBRK_SIZE. Defaults to SBRK_SIZE.
+ *  * TCACHE_COUNT: with THREAD_CACHE, how many freed blocks of each small
+ *    size class a thread keeps for itself. When a class fills up, half of
+ *    it goes back to the heap at once. 0 turns caching off, though blocks
+ *    already cached are still handed out. Defaults to 16.
+ *  * ARENA_COUNT: with THREAD_SAFE, how many arenas threads are spread
+ *    over, round-robin, each thread getting its arena the first time it
+ *    allocates. From 1 to MAX_ARENAS, defaulting to the number of online
+ *    cores. Blocks are always freed back to the arena they came from.
+ *  * FASTBIN_MAX: frees of blocks for requests of at most this many bytes
+ *    are not merged with their neighbors but kept on quick lists per size
+ *    in the arena, to be reused as they are. The lists are merged back
+ *    into the heap when nothing else free fits a request, before the heap
+ *    grows, when they grow long, and on my_malloc_trim. From 0, the
+ *    default, which turns them off, to 160.
+ *  * GOOD_FIT_COUNT: how many blocks that fit my_malloc_good_fit looks at
+ *    before settling for the smallest of them. At least 1, defaults to 8.
+ *  * GOOD_FIT_SLACK: how many percent bigger than needed a block can be
+ *    for my_malloc_good_fit to take it at once. Defaults to 25.
+ *  * SLAB_THRESHOLD: with SLAB, requests of at most this many bytes come
+ *    out of slabs, pages of equal slots with no metadata per slot, before
+ *    trying the heap. From 0, which turns slabs off (slots already handed
+ *    out can still be freed), to 256, the default.
+ * with THREAD_SAFE, set these before other threads start allocating,
+ * since they are read without any lock.
+ */
+enum MALLOPT { MMAP_THRESHOLD, TRIM_THRESHOLD, GROW_POLICY, GROW_CHUNK, TCACHE_COUNT, ARENA_COUNT, FASTBIN_MAX, GOOD_FIT_COUNT, GOOD_FIT_SLACK, SLAB_THRESHOLD };
+enum GROW { GROW_FIXED, GROW_GEOMETRIC };
+int my_mallopt(enum MALLOPT, size_t);
+
+/* MALLOC TRIM
+ *
+ * gives all free memory at the top of each arena's heap back with a
+ * negative my_sbrk, except for pad bytes of it. Returns 1 if any memory was given
+ * back and 0 if not.
+ */
+int my_malloc_trim(size_t);
+
 /* ENUMS
 
 ORDER tells general add and free helper functions whether to operate with a
-size or address ordered free list.
+size or address ordered free list, or with the segregated or TLSF bins.
+NEXT_FIT and GOOD_FIT use the address ordered free list too.
 */
-enum ORDER { SIZE, ADDRESS };
+enum ORDER { SIZE, ADDRESS, SEGREGATED, TLSF, NEXT_FIT, GOOD_FIT };
+
+/* HEAP HANDLES
+ *
+ * a heap of its own, kept apart from the one the functions above share,
+ * for a part of the program that wants its memory isolated and gone in
+ * one step.
+ *  * my_heap_create sets up a heap over the size bytes at region, or over
+ *    a fresh my_mmap mapping of size bytes if region is NULL. Its
+ *    bookkeeping sits at the start of the region, so nothing else is
+ *    allocated for it. Blocks are kept in the given order for the heap's
+ *    whole life. Returns NULL if the region has no room for at least one
+ *    SBRK_SIZE chunk, if the mapping fails, or for SEGREGATED and TLSF
+ *    without -DBOUNDARY_TAGS.
+ *  * my_heap_malloc and my_heap_free work like the functions for the
+ *    heap's order, on that heap only. Nothing is ever mapped on its own or
+ *    cached per thread; once the region is used up requests get NULL and
+ *    OUT_OF_MEMORY. Blocks must go back to the heap they came from.
+ *  * my_heap_destroy drops the heap and every block still in it at once,
+ *    unmapping the region if my_heap_create mapped it.
+ * the functions above work the same way over the arenas (see my_malloc.c),
+ * which are my_heap_t too.
+ */
+typedef struct arena my_heap_t;
+my_heap_t* my_heap_create(void*, size_t, enum ORDER);
+void* my_heap_malloc(my_heap_t*, size_t);
+void my_heap_free(my_heap_t*, void*);
+void my_heap_destroy(my_heap_t*);
+
+/* REGIONS
+ *
+ * for memory that is all freed at once, such as everything one request
+ * needs. A region hands out memory by bumping a pointer through chunks it
+ * gets from the same heap the functions above use, and nothing handed
+ * out can be freed on its own.
+ *  * my_region_create starts an empty region, or returns NULL with ERRNO
+ *    set if the heap has no room for its first chunk.
+ *  * my_region_alloc returns size bytes aligned to 16, or NULL with ERRNO
+ *    set if a new chunk was needed and could not be had.
+ *  * my_region_reset frees everything allocated from the region, so it
+ *    can be used again.
+ *  * my_region_destroy frees everything and the region itself.
+ * only one thread may use a given region at a time.
+ */
+typedef struct region my_region_t;
+my_region_t* my_region_create();
+void* my_region_alloc(my_region_t*, size_t);
+void my_region_reset(my_region_t*);
+void my_region_destroy(my_region_t*);
 
 /* HELPER FUNCS
 See my_malloc.c for documentation.
 */
+void* mallocInOrder(enum ORDER, size_t);
+void freeInOrder(enum ORDER, void*);
 void* getMemory(size_t);
+size_t getBlockSize(size_t);
 void addToFreeList(metadata_t*);
 metadata_t* findLeftBlk(metadata_t*);
 metadata_t* findRightBlk(metadata_t*);
 metadata_t* coalesceLeftAndRight(void*);
 void removeFromFreelist(metadata_t*);
 short getFreelistSize();
+size_t getMmapThreshold();
+metadata_t* extendHeap(size_t);
+void setOrder(enum ORDER);
+void* mapLarge(size_t);
+void unmapLarge(metadata_t*);
+void* mapLargeAligned(size_t, size_t);
+char* getMapping(metadata_t*);
+size_t getMappedSize(metadata_t*);
+metadata_t peekHeader(metadata_t*);
+metadata_t* findTopBlk();
+size_t trimTop(metadata_t*, size_t);
+void useHomeArena();
+void useArenaOf(metadata_t*);
+void* arenaSbrk(int);
+void* getMemoryFromArena(size_t);
+void* getMemoryByOrder(size_t);
+metadata_t* findNextFit(size_t);
+metadata_t* findGoodFit(size_t);
+void* takeFreeBlock(metadata_t*, size_t);
+void* takeFromFastbin(size_t);
+int putInFastbin(metadata_t*);
+void consolidateFastbins();
+void* allocChunk(size_t);
+void freeChunk(void*);
+void* allocBlock(size_t);
+void freeBlock(void*);
+int resizeInPlace(metadata_t*, size_t);
+void* moveBlock(void*, size_t, size_t);
+void clearBlock(char*, size_t, char*, char*);
+int compareAddresses(const void*, const void*);
+#ifdef THREAD_SAFE
+int arenaIndexOf(metadata_t*);
+void initArenas();
+void deferFree(metadata_t*, metadata_t*);
+void drainRemoteFrees();
+#endif
+#ifdef SLAB
+void mapSlabPool();
+slab_t* newSlab(int);
+void unlinkSlab(slab_t*);
+void* allocSlot(size_t);
+int freeSlot(void*);
+slab_t* slabOf(void*);
+#endif
+#ifdef FREE_INDEX
+metadata_t* findInIndex(size_t);
+int findListPlace(metadata_t*, metadata_t**);
+void dropIndex();
+void addToIndex(metadata_t*);
+void removeFromIndex(metadata_t*);
+void rebuildIndex();
+#endif
+#ifdef SIDE_METADATA
+int mapSideTable();
+metadata_t* findSideEntry(void*);
+#endif
+#ifdef THREAD_CACHE
+void makeCacheKey();
+void* takeFromCache(size_t);
+int putInCache(metadata_t*);
+void fillCache(size_t);
+void flushCache(int, size_t);
+void releaseCache(void*);
+#endif
+#ifdef BOUNDARY_TAGS
+footer_t* getFooter(metadata_t*);
+void setFooter(metadata_t*);
+void* getMemoryFromBins(size_t);
+metadata_t* findInBins(size_t);
+int getBinIndex(size_t);
+void addToBin(metadata_t*);
+void removeFromBin(metadata_t*);
+void mapTLSF(size_t, int*, int*);
+metadata_t* findInTLSF(size_t);
+void addToTLSF(metadata_t*);
+void removeFromTLSF(metadata_t*);
+metadata_t* findBestFitInTree(size_t);
+void addToTree(metadata_t*);
+void removeFromTree(metadata_t*);
+#endif
 
 #endif /* __MY_MALLOC_H__ */
@@ -1,5 +1,8 @@
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "my_malloc.h"
 
 /* emulates a call to the system call sbrk(2) */
 
@@ -13,23 +16,214 @@
 /* 0x2000 base 16 = 8192 base 10 = 8 KB */
 #define HEAP_SIZE 0x2000
 
+/* how much address space SBRK_RESERVED sets aside when not told otherwise */
+#define DEFAULT_RESERVE ((size_t) 1 << 32)
+
+/* the size of a transparent huge page on x86-64 and most arm64 kernels */
+#define HUGE_PAGE ((size_t) 2 << 20)
+
+/* emulated heaps start on a cache line, the way a real one starts on a
+ * page, so an allocator that keeps its blocks on cache lines loses none
+ * of it to padding
+ */
+#define CACHE_LINE 64
+
+/* every arena has a heap of its own, region i belonging to arena i. each
+ * region is heap_limit bytes starting at fake_heap[i], of which the first
+ * current_top_of_heap[i] are handed out. with SBRK_RESERVED only the first
+ * committed[i] bytes (a whole number of pages) are readable and writable,
+ * the rest is reserved address space that costs nothing until the break
+ * moves into it. SBRK_HUGE does the same in whole huge pages, so every
+ * region starts on a HUGE_PAGE boundary and committed[i] is a whole
+ * number of them.
+ */
+static enum SBRK_BACKEND backend = SBRK_EMULATED;
+static char *fake_heap[MAX_ARENAS];
+static size_t heap_limit = HEAP_SIZE;
+static size_t current_top_of_heap[MAX_ARENAS];
+static size_t committed[MAX_ARENAS];
+/* the highest current_top_of_heap[i] has ever been */
+static size_t high_water[MAX_ARENAS];
+
+int my_sbrk_init(enum SBRK_BACKEND which, size_t reserve) {
+  for (int i = 0; i < MAX_ARENAS; i++) {
+    if (fake_heap[i] != NULL) {
+      return 0;
+    }
+  }
+  backend = which;
+  if (which == SBRK_RESERVED) {
+    heap_limit = reserve != 0 ? reserve : DEFAULT_RESERVE;
+  } else if (which == SBRK_HUGE) {
+    heap_limit = reserve != 0 ? reserve : DEFAULT_RESERVE;
+    heap_limit = (heap_limit + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+  } else {
+    heap_limit = HEAP_SIZE;
+  }
+  return 1;
+}
+
+/* sets aside heap_limit bytes of address space that cannot be touched
+ * yet, starting on a HUGE_PAGE boundary for SBRK_HUGE. the kernel is
+ * asked to back that with huge pages. if it will not, because
+ * transparent huge pages are off or not built in, the heap just gets
+ * normal pages. MAP_HUGETLB is not used, since without pages set aside
+ * in hugetlbfs the first touch past the pool would be a SIGBUS and not
+ * a failed my_sbrk.
+ */
+static char *reserve_heap(void) {
+  size_t extra = backend == SBRK_HUGE ? HUGE_PAGE : 0;
+  char *reserved = mmap(NULL, heap_limit + extra, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) {
+    return NULL;
+  }
+  if (extra == 0) {
+    return reserved;
+  }
+  char *base = (char *) (((uintptr_t) reserved + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+  if (base != reserved) {
+    munmap(reserved, base - reserved);
+  }
+  if (base != reserved + extra) {
+    munmap(base + heap_limit, reserved + extra - base);
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(base, heap_limit, MADV_HUGEPAGE);
+#endif
+  return base;
+}
+
+/* makes exactly the pages holding the first top bytes of a reserved heap
+ * usable. pages past there that were in use before are dropped with
+ * madvise, so they stop counting against us, and made inaccessible again.
+ * with SBRK_HUGE these are huge pages. a break that moves down inside one
+ * keeps all of it, and it only goes back once the break is below its
+ * start, so trimming never splits a huge page into small ones.
+ */
+static int commit_to(int arena, size_t top) {
+  size_t page = backend == SBRK_HUGE ? HUGE_PAGE : (size_t) sysconf(_SC_PAGESIZE);
+  size_t want = (top + page - 1) & ~(page - 1);
+  char *base = fake_heap[arena];
+  if (want > committed[arena]) {
+    if (mprotect(base + committed[arena], want - committed[arena],
+                 PROT_READ | PROT_WRITE) != 0) {
+      return -1;
+    }
+  } else if (want < committed[arena]) {
+    madvise(base + want, committed[arena] - want, MADV_DONTNEED);
+    mprotect(base + want, committed[arena] - want, PROT_NONE);
+  }
+  committed[arena] = want;
+  return 0;
+}
+
 void *my_sbrk(int increment) {
+  return my_sbrk_arena(0, increment);
+}
+
+/* the same as my_sbrk, for the heap of the given arena. only one thread
+ * may be moving a given arena's break at a time.
+ */
+void *my_sbrk_arena(int arena, int increment) {
 
-  static char *fake_heap = NULL;
-  static int current_top_of_heap = 0;
   void *ret_val;
+  char *base = fake_heap[arena];
 
-  if(fake_heap == NULL){
-    if((fake_heap = calloc(HEAP_SIZE, 1)) == NULL) {
+  if(base == NULL){
+    if (backend != SBRK_EMULATED) {
+      if ((base = reserve_heap()) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+      }
+    } else if((base = calloc(HEAP_SIZE + CACHE_LINE, 1)) == NULL) {
       return NULL;
+    } else {
+      base = (char *) (((uintptr_t) base + CACHE_LINE - 1) & ~(uintptr_t) (CACHE_LINE - 1));
     }
+    /* published for my_sbrk_owner, which other threads call unlocked */
+    __atomic_store_n(&fake_heap[arena], base, __ATOMIC_RELEASE);
+  }
+  ret_val=current_top_of_heap[arena]+base;
+  if ((increment > 0 && (size_t) increment > heap_limit - current_top_of_heap[arena])
+      || (increment < 0 && (size_t) -(long) increment > current_top_of_heap[arena])) {
+    errno=ENOMEM;
+    return NULL;
   }
-  ret_val=current_top_of_heap+fake_heap;
-  if ((current_top_of_heap + increment > HEAP_SIZE)
-      || (current_top_of_heap+increment < 0)) {
+  if (backend != SBRK_EMULATED
+      && commit_to(arena, current_top_of_heap[arena] + increment) != 0) {
     errno=ENOMEM;
     return NULL;
   }
-  current_top_of_heap += increment;
+  current_top_of_heap[arena] += increment;
+  if (current_top_of_heap[arena] > high_water[arena]) {
+    high_water[arena] = current_top_of_heap[arena];
+  }
   return ret_val;
 }
+
+/* returns the address in the given arena's heap that the break has never
+ * gone past, or NULL if the heap could not be set up. everything from
+ * there on is as calloc or mmap left it, all zero, since madvise gives
+ * dropped pages back zeroed too. only one thread may be moving the
+ * arena's break while this runs.
+ */
+void *my_sbrk_untouched(int arena) {
+  if (my_sbrk_arena(arena, 0) == NULL) {
+    return NULL;
+  }
+  return fake_heap[arena] + high_water[arena];
+}
+
+/* returns one past the furthest the given arena's heap can ever reach,
+ * or NULL if the heap could not be set up.
+ */
+void *my_sbrk_end(int arena) {
+  if (my_sbrk_arena(arena, 0) == NULL) {
+    return NULL;
+  }
+  return fake_heap[arena] + heap_limit;
+}
+
+/* returns which arena's heap ptr lies in, or -1 if it is in none of them. */
+int my_sbrk_owner(void *ptr) {
+  for (int i = 0; i < MAX_ARENAS; i++) {
+    char *base = __atomic_load_n(&fake_heap[i], __ATOMIC_ACQUIRE);
+    if (base != NULL && (char *) ptr >= base && (char *) ptr < base + heap_limit) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* hands out a fresh anonymous mapping of length bytes for blocks too
+ * large to come out of the heap, or NULL if the system has none to give.
+ * unlike my_sbrk this is the real thing, since these never share space
+ * with the heap and each one goes straight back with my_munmap.
+ */
+void *my_mmap(size_t length) {
+  void *ret_val = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ret_val == MAP_FAILED) {
+    return NULL;
+  }
+  return ret_val;
+}
+
+/* like my_mmap, for bookkeeping that shadows a whole heap and is mostly
+ * never touched. the system is not asked to set memory aside for all of
+ * it up front, so pages nobody writes cost nothing.
+ */
+void *my_mmap_sparse(size_t length) {
+  void *ret_val = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ret_val == MAP_FAILED) {
+    return NULL;
+  }
+  return ret_val;
+}
+
+/* returns a mapping from my_mmap or my_mmap_sparse to the system. */
+void my_munmap(void *start, size_t length) {
+  munmap(start, length);
+}
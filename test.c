@@ -1,10 +1,22 @@
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sched.h>
 #include "my_malloc.h"
 
 typedef void* (*malloc_func_type)(size_t);
 typedef void (*free_func_type)(void *);
 
+/* the metadata of the block whose user memory is at ptr, which with side
+ * metadata is not in front of it but in its heap's table */
+#ifdef SIDE_METADATA
+#define HEAD_OF(ptr) findSideEntry(ptr)
+#else
+#define HEAD_OF(ptr) ((metadata_t*) ((char*) (ptr) - HEADER_SIZE))
+#endif
+
 void test(malloc_func_type my_malloc, free_func_type my_free) {
 	int test = 0;
 
@@ -56,12 +68,35 @@ void test(malloc_func_type my_malloc, free_func_type my_free) {
 
 	/* Tests for SINGLE_REQUEST_TOO_LARGE */
 	printf("\n");
-	void* thisIsNull = my_malloc(2049);
+	void* thisIsNull = my_malloc((size_t) -1);
 	printf("\n%d. Asking for too much data should set error code to SINGLE_REQUEST_TOO_LARGE: %d", ++test, ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
 	printf("\n%d. The returned pointer should also be null: %d", ++test, thisIsNull == NULL ? 1 : 0);
 
 
 
+	/* Tests for requests too large for the heap getting their own mapping */
+	printf("\n");
+	char* mapped = (char*) my_malloc(100000);
+	printf("\n%d. Asking for more than a heap block holds should still succeed: %d", ++test, mapped != NULL && ERRNO == NO_ERROR ? 1 : 0);
+	mapped[0] = 1;
+	mapped[99999] = 2;
+	printf("\n%d. Both ends of the mapping should be usable: %d", ++test, mapped[0] + mapped[99999] == 3 ? 1 : 0);
+	printf("\n%d. Block should be marked as mapped: %d", ++test, IS_MMAPPED(HEAD_OF(mapped)) ? 1 : 0);
+	short before = getFreelistSize();
+	my_free(mapped);
+	printf("\n%d. Freeing it should leave the heap alone: %d", ++test, getFreelistSize() == before && ERRNO == NO_ERROR ? 1 : 0);
+	size_t threshold = getMmapThreshold();
+	my_mallopt(MMAP_THRESHOLD, 100);
+	void* overThreshold = my_malloc(101);
+	void* atThreshold = my_malloc(100);
+	printf("\n%d. Lowering the threshold should map requests just over it, but not at it: %d", ++test, IS_MMAPPED(HEAD_OF(overThreshold)) && !IS_MMAPPED(HEAD_OF(atThreshold)) ? 1 : 0);
+	my_free(overThreshold);
+	my_free(atThreshold);
+	printf("\n%d. Threshold above what the heap can hold should be refused: %d", ++test, my_mallopt(MMAP_THRESHOLD, (size_t) -1) == 0 ? 1 : 0);
+	my_mallopt(MMAP_THRESHOLD, threshold);
+
+
+
 	/* Tests for modifying data and saving state correctly */
 	printf("\n");
 	int* num = (int*) my_malloc(sizeof(int));
@@ -99,17 +134,25 @@ void test(malloc_func_type my_malloc, free_func_type my_free) {
 	/* Tests for making sure bulk mallocs are all in use and correctly freed. */
 	printf("\n");
 	void* manyMalloc[16];
+	/* Boundary tags put 8 more bytes in each block, so 8 less is asked
+	for to keep four blocks to a 2048 byte chunk, the way 480 does in the
+	default layout. */
+#ifdef BOUNDARY_TAGS
+	size_t manySize = 472;
+#else
+	size_t manySize = 480;
+#endif
 	for (int i = 0; i < 16; i++) {
-		manyMalloc[i] = my_malloc(488);
+		manyMalloc[i] = my_malloc(manySize);
 	}
 	printf("\n%d. All user allocated memory should be in use: ", ++test);
 	int all1 = 1;
 	for (int i = 0; i < 16; i++) {
-		metadata_t* pt = (metadata_t*) (((char*) manyMalloc[i]) - sizeof(metadata_t));
+		metadata_t* pt = HEAD_OF(manyMalloc[i]);
 		// if (pt->in_use == 0) {
 		// 	all1 = 0;
 		// }
-		printf("%d",  pt->in_use);
+		printf("%d",  IS_IN_USE(pt));
 	}
 
 	/* Free odd-indexed memory */
@@ -273,9 +316,884 @@ void test(malloc_func_type my_malloc, free_func_type my_free) {
 	my_free(n1x);
 	my_free(nCritical);
 
+
+
+#ifdef BOUNDARY_TAGS
+	/* Tests for finding neighbors through boundary tags instead of the freelist. */
+	printf("\n");
+	void *b1 = my_malloc(40);
+	void *b2 = my_malloc(40);
+	void *b3 = my_malloc(40);
+	void *b4 = my_malloc(40);
+	my_free(b1);
+	my_free(b3);
+	metadata_t* b1Head = HEAD_OF(b1);
+	metadata_t* b2Head = HEAD_OF(b2);
+	metadata_t* b3Head = HEAD_OF(b3);
+	metadata_t* b4Head = HEAD_OF(b4);
+	printf("\n%d. Left of b2 should be free block b1: %d", ++test, findLeftBlk(b2Head) == b1Head ? 1 : 0);
+	printf("\n%d. Right of b2 should be free block b3: %d", ++test, findRightBlk(b2Head) == b3Head ? 1 : 0);
+	printf("\n%d. Left of b1 should not be a free block: %d", ++test, findLeftBlk(b1Head) == NULL ? 1 : 0);
+	my_free(b2);
+	printf("\n%d. After b2 freed, left of b4 should be one block starting at b1: %d", ++test, findLeftBlk(b4Head) == b1Head ? 1 : 0);
+	my_free(b4);
+#endif
+#ifdef COMPACT_HEADER
+	/* Tests for the one word header. */
+	void *c1 = my_malloc(1);
+	void *c2 = my_malloc(1);
+	printf("\n%d. Compact header should be a single word: %d", ++test, HEADER_SIZE == sizeof(size_t) ? 1 : 0);
+	printf("\n%d. A 1 byte request should only need room for the links and footer once freed: %d", ++test, getBlockSize(1) == sizeof(metadata_t) + sizeof(footer_t) ? 1 : 0);
+	printf("\n%d. User memory should be word aligned: %d", ++test, ((size_t) c1 % sizeof(size_t)) == 0 && ((size_t) c2 % sizeof(size_t)) == 0 ? 1 : 0);
+	my_free(c1);
+	my_free(c2);
+#endif
+#ifdef SIDE_METADATA
+	/* Tests for keeping metadata in a table apart from the heap. */
+	char *d1 = (char*) my_malloc(1);
+	char *d2 = (char*) my_malloc(1);
+	char *d3 = (char*) my_malloc(100000);
+	printf("\n%d. A 1 byte request should take one whole cache line: %d", ++test, getBlockSize(1) == SIDE_GRANULE ? 1 : 0);
+	printf("\n%d. User memory should start on a cache line, mapped or not: %d", ++test, (uintptr_t) d1 % SIDE_GRANULE == 0 && (uintptr_t) d2 % SIDE_GRANULE == 0 && (uintptr_t) d3 % SIDE_GRANULE == 0 ? 1 : 0);
+	printf("\n%d. Blocks next to each other should have entries next to each other: %d", ++test, d2 == d1 + SIDE_GRANULE && HEAD_OF(d2) == HEAD_OF(d1) + 1 ? 1 : 0);
+	memset(d1, 0xff, SIDE_GRANULE);
+	printf("\n%d. Writing all of a block should leave its neighbor's metadata alone: %d", ++test, IS_IN_USE(HEAD_OF(d2)) && GET_SIZE(HEAD_OF(d2)) == SIDE_GRANULE ? 1 : 0);
+	my_free(d1);
+	printf("\n%d. Freeing should leave all of the block's memory as the user left it: %d", ++test, (unsigned char) d1[0] == 0xff && (unsigned char) d1[SIDE_GRANULE - 1] == 0xff ? 1 : 0);
+	my_free(d2);
+	my_free(d3);
+#endif
+
+}
+
+void test_best_fit() {
+	int test = 0;
+
+	/* Tests for address order picking the best fit, lowest address first on ties. */
+	printf("\n");
+	void *big = my_malloc_addr_order(100);
+	void *bigx = my_malloc_addr_order(1);
+	void *fit1 = my_malloc_addr_order(60);
+	void *fit1x = my_malloc_addr_order(1);
+	void *fit2 = my_malloc_addr_order(60);
+	void *fit2x = my_malloc_addr_order(1);
+	my_free_addr_order(fit2);
+	my_free_addr_order(big);
+	my_free_addr_order(fit1);
+	void *best = my_malloc_addr_order(60);
+	printf("\n%d. Best fit should skip the bigger block and take the lowest of two exact fits: %d", ++test, best == fit1 ? 1 : 0);
+	void *next = my_malloc_addr_order(50);
+	printf("\n%d. Next best fit should be the other exact fit: %d", ++test, next == fit2 ? 1 : 0);
+	my_free_addr_order(best);
+	my_free_addr_order(next);
+	my_free_addr_order(bigx);
+	my_free_addr_order(fit1x);
+	my_free_addr_order(fit2x);
+	printf("\n");
 }
 
+#ifdef BOUNDARY_TAGS
+void test_bins(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for serving requests out of the size class bins. */
+	printf("\n");
+	void *p = my_malloc(40);
+	void *px = my_malloc(1);
+	my_free(p);
+	void *q = my_malloc(40);
+	printf("\n%d. Same size request should come right back out of its exact bin: %d", ++test, q == p ? 1 : 0);
+	my_free(q);
+	void *r = my_malloc(30);
+	printf("\n%d. Smaller request should come from the first non-empty bin above its own: %d", ++test, r == p ? 1 : 0);
+	my_free(r);
+	my_free(px);
+	printf("\n");
+}
+#endif
+
+void test_trim(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for giving free memory at the top of the heap back to my_sbrk. */
+	printf("\n");
+	void* blocks[3];
+	for (int i = 0; i < 3; i++) {
+		blocks[i] = my_malloc(1500);
+	}
+	for (int i = 0; i < 3; i++) {
+		my_free(blocks[i]);
+	}
+	char* brk = (char*) my_sbrk(0);
+	printf("\n%d. Trimming with free memory on top of the heap should give some back: %d", ++test, my_malloc_trim(0) == 1 && (char*) my_sbrk(0) < brk ? 1 : 0);
+	for (int i = 0; i < 3; i++) {
+		blocks[i] = my_malloc(1500);
+	}
+	brk = (char*) my_sbrk(0);
+	for (int i = 0; i < 3; i++) {
+		my_free(blocks[i]);
+	}
+	printf("\n%d. Freeing less than the trim threshold should leave the heap alone: %d", ++test, (char*) my_sbrk(0) == brk ? 1 : 0);
+	for (int i = 0; i < 3; i++) {
+		blocks[i] = my_malloc(1500);
+	}
+	my_mallopt(TRIM_THRESHOLD, 2048);
+	for (int i = 0; i < 3; i++) {
+		my_free(blocks[i]);
+	}
+	printf("\n%d. Freeing more than the trim threshold on top should shrink the heap: %d", ++test, (char*) my_sbrk(0) < brk ? 1 : 0);
+	printf("\n%d. Trimming should not give back the pad: %d", ++test, my_malloc_trim(4096) == 0 ? 1 : 0);
+	my_mallopt(TRIM_THRESHOLD, 128 * 1024);
+	void* after = my_malloc(1500);
+	printf("\n%d. Heap should grow back after a trim: %d", ++test, after != NULL ? 1 : 0);
+	my_free(after);
+	printf("\n");
+}
+
+void test_fits() {
+	int test = 0;
+
+	/* Tests for next fit and good fit, on heaps of their own so nothing else is free. */
+	printf("\n");
+	static char region[16 * 1024];
+	my_heap_t* heap = my_heap_create(region, sizeof(region), NEXT_FIT);
+	void* blocks[6];
+	for (int i = 0; i < 6; i++) {
+		blocks[i] = my_heap_malloc(heap, i % 2 == 0 ? 60 : 1);
+	}
+	for (int i = 0; i < 6; i += 2) {
+		my_heap_free(heap, blocks[i]);
+	}
+	void* next = my_heap_malloc(heap, 60);
+	printf("\n%d. Next fit should carry on from the last search instead of the start: %d", ++test, (char*) next > (char*) blocks[5] ? 1 : 0);
+	/* Once the rest of the heap is used up, the search wraps around. */
+	for (int i = 0; i < 100 && (char*) next > (char*) blocks[5]; i++) {
+		next = my_heap_malloc(heap, 60);
+	}
+	printf("\n%d. Next fit should wrap around to the lowest block that fits: %d", ++test, next == blocks[0] ? 1 : 0);
+	printf("\n%d. Next fit should then go on from there: %d", ++test, my_heap_malloc(heap, 60) == blocks[2] ? 1 : 0);
+	my_heap_destroy(heap);
+
+	heap = my_heap_create(region, sizeof(region), GOOD_FIT);
+	size_t sizes[6] = { 1000, 1, 600, 1, 500, 1 };
+	for (int i = 0; i < 6; i++) {
+		blocks[i] = my_heap_malloc(heap, sizes[i]);
+	}
+	for (int i = 0; i < 6; i += 2) {
+		my_heap_free(heap, blocks[i]);
+	}
+	void* good = my_heap_malloc(heap, 500);
+	printf("\n%d. Good fit should take the first block close enough instead of the best: %d", ++test, good == blocks[2] ? 1 : 0);
+	my_heap_free(heap, good);
+	my_mallopt(GOOD_FIT_SLACK, 0);
+	printf("\n%d. GOOD_FIT_COUNT of 0 should be refused: %d", ++test, my_mallopt(GOOD_FIT_COUNT, 0) == 0 ? 1 : 0);
+	my_mallopt(GOOD_FIT_COUNT, 2);
+	good = my_heap_malloc(heap, 500);
+	printf("\n%d. Good fit should settle for the smallest of the first few that fit: %d", ++test, good == blocks[2] ? 1 : 0);
+	my_mallopt(GOOD_FIT_COUNT, 3);
+	my_heap_free(heap, good);
+	printf("\n%d. Looking at more of them should find the best: %d", ++test, my_heap_malloc(heap, 500) == blocks[4] ? 1 : 0);
+	my_mallopt(GOOD_FIT_COUNT, 8);
+	my_mallopt(GOOD_FIT_SLACK, 25);
+	my_heap_destroy(heap);
+	printf("\n");
+}
+
+void test_index(enum ORDER order) {
+	int test = 0;
+
+	/* Tests that ties between free blocks of one size go the way the
+	freelist walk takes them, on a heap of its own so nothing else is
+	free. Size order takes the block freed first, address order the lowest. */
+	printf("\n");
+	static char region[32 * 1024];
+	my_heap_t* heap = my_heap_create(region, sizeof(region), order);
+	size_t sizes[6] = { 200, 100, 200, 100, 400, 100 };
+	void* blocks[6];
+	for (int i = 0; i < 6; i++) {
+		blocks[i] = my_heap_malloc(heap, sizes[i]);
+		my_heap_malloc(heap, 1);
+	}
+	/* With the rest of the heap used up, every free goes into a list of
+	only these, so each place findListPlace can pick comes up. */
+	while (my_heap_malloc(heap, 1) != NULL) {
+	}
+	int frees[6] = { 2, 3, 1, 0, 4, 5 };
+	for (int i = 0; i < 6; i++) {
+		my_heap_free(heap, blocks[frees[i]]);
+	}
+	int sizeOrder[3] = { 3, 1, 5 };
+	int addrOrder[3] = { 1, 3, 5 };
+	int taken = 1;
+	for (int i = 0; i < 3; i++) {
+		void* want = blocks[order == SIZE ? sizeOrder[i] : addrOrder[i]];
+		taken = taken && my_heap_malloc(heap, 100) == want;
+	}
+	printf("\n%d. Exact fits of one size should be taken in the walk's order: %d", ++test, taken);
+	void* first = order == SIZE ? blocks[2] : blocks[0];
+	void* second = order == SIZE ? blocks[0] : blocks[2];
+	printf("\n%d. The same should go for a bigger size: %d", ++test, my_heap_malloc(heap, 200) == first ? 1 : 0);
+	printf("\n%d. A request between sizes should get the next size up: %d", ++test, my_heap_malloc(heap, 300) == blocks[4] ? 1 : 0);
+	printf("\n%d. The last exact fit should still be found: %d", ++test, my_heap_malloc(heap, 200) == second ? 1 : 0);
+	my_heap_destroy(heap);
+
+	/* Switching orders drops the index or fills it again from the list. */
+	void* block = my_malloc_size_order(1234);
+	void* guard = my_malloc_size_order(1);
+	my_free_size_order(block);
+	my_free_addr_order(my_malloc_addr_order(1));
+	my_free_next_fit(my_malloc_next_fit(1));
+	my_free_addr_order(my_malloc_addr_order(1));
+	printf("\n%d. A free block should still be found after switching orders: %d", ++test, my_malloc_size_order(1234) == block ? 1 : 0);
+	my_free_size_order(block);
+	my_free_size_order(guard);
+	printf("\n");
+}
+
+void test_realloc(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for resizing blocks, in place where possible. */
+	printf("\n");
+	char* a = (char*) my_malloc(100);
+	void* b = my_malloc(100);
+	void* guard = my_malloc(100);
+	for (int i = 0; i < 100; i++) {
+		a[i] = (char) i;
+	}
+	my_free(b);
+	printf("\n%d. Growing into a free right neighbor should not move the block: %d", ++test, my_realloc(a, 180) == a ? 1 : 0);
+	int intact = 1;
+	for (int i = 0; i < 100; i++) {
+		intact = intact && a[i] == (char) i;
+	}
+	printf("\n%d. Growing in place should keep the contents: %d", ++test, intact);
+	printf("\n%d. Shrinking should not move the block: %d", ++test, my_realloc(a, 20) == a ? 1 : 0);
+	printf("\n%d. The tail given up by shrinking should be free to grow back into: %d", ++test, my_realloc(a, 180) == a ? 1 : 0);
+	/* More than the block and a free right neighbor hold between them forces a move. */
+	metadata_t* head = HEAD_OF(a);
+	metadata_t* right = findRightBlk(head);
+	size_t room = GET_SIZE(head) + (right != NULL && !IS_IN_USE(right) ? GET_SIZE(right) : 0);
+	char* moved = (char*) my_realloc(a, room + 1);
+	intact = moved != NULL && moved != a;
+	for (int i = 0; intact && i < 20; i++) {
+		intact = moved[i] == (char) i;
+	}
+	printf("\n%d. A block that cannot grow in place should move with its contents: %d", ++test, intact);
+	printf("\n%d. A request that cannot be met should leave the block alone: %d", ++test, my_realloc(moved, SIZE_MAX) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE && moved[19] == 19 ? 1 : 0);
+	printf("\n%d. A size of 0 should free the block: %d", ++test, my_realloc(moved, 0) == NULL && ERRNO == NO_ERROR ? 1 : 0);
+	void* fresh = my_realloc(NULL, 100);
+	printf("\n%d. A NULL block should be allocated: %d", ++test, fresh != NULL ? 1 : 0);
+	my_free(fresh);
+#ifdef BOUNDARY_TAGS
+	if (my_malloc == my_malloc_addr_order) {
+		/* Address order keeps every free block in its trees, so a tail too
+		small to hold a tree node stays with the block. */
+		char* c = (char*) my_malloc(200);
+		void* neighbor = my_malloc(1);
+		size_t full = GET_SIZE(HEAD_OF(c));
+		my_realloc(c, 200 - sizeof(treenode_t));
+		printf("\n%d. Shrinking should not free a tail too small for the trees: %d", ++test, (size_t) GET_SIZE(HEAD_OF(c)) == full ? 1 : 0);
+		my_free(neighbor);
+		my_free(c);
+	}
+#endif
+	my_free(guard);
+	printf("\n");
+}
+
+void test_calloc(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for zeroed allocation. */
+	printf("\n");
+	char* used = (char*) my_malloc(300);
+	for (int i = 0; i < 300; i++) {
+		used[i] = (char) 0xff;
+	}
+	my_free(used);
+	char* cleared = (char*) my_calloc(30, 10);
+	int zero = cleared != NULL;
+	for (int i = 0; zero && i < 300; i++) {
+		zero = cleared[i] == 0;
+	}
+	printf("\n%d. Recycled memory should come back zeroed: %d", ++test, zero);
+	/* Big enough that nothing free fits, so the heap grows for it. */
+	char* grown = (char*) my_calloc(1, 1900);
+	zero = grown != NULL;
+	for (int i = 0; zero && i < 1900; i++) {
+		zero = grown[i] == 0;
+	}
+	printf("\n%d. Memory fresh from the heap's growth should be zero: %d", ++test, zero);
+	char* large = (char*) my_calloc(1024, 1024);
+	zero = large != NULL;
+	for (int i = 0; zero && i < 1024 * 1024; i += 4096) {
+		zero = large[i] == 0;
+	}
+	printf("\n%d. A mapped block should be zero: %d", ++test, zero);
+	printf("\n%d. A count and size too large together should be refused: %d", ++test, my_calloc(SIZE_MAX / 2, 3) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
+	my_free(large);
+	my_free(grown);
+	my_free(cleared);
+	printf("\n");
+}
+
+void test_memalign(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for aligned allocation. */
+	printf("\n");
+	void* guard = my_malloc(1);
+	short freelistSize = getFreelistSize();
+	void* blocks[3];
+	int aligned = 1;
+	for (int i = 0; i < 3; i++) {
+		size_t alignment = (size_t) 32 << i;
+		blocks[i] = my_memalign(alignment, 100);
+		aligned = aligned && blocks[i] != NULL && (uintptr_t) blocks[i] % alignment == 0;
+	}
+	printf("\n%d. Blocks should start on a multiple of their alignment: %d", ++test, aligned);
+	for (int i = 0; i < 3; i++) {
+		my_free(blocks[i]);
+	}
+	printf("\n%d. Freeing them should merge the slop back in: %d", ++test, getFreelistSize() == freelistSize ? 1 : 0);
+#ifdef BOUNDARY_TAGS
+	if (my_malloc == my_malloc_addr_order) {
+		/* Address order keeps every free block in its trees, so slop cut
+		off the front has to be big enough to hold a tree node. */
+		int fits = 1;
+		for (int i = 0; i < 3; i++) {
+			blocks[i] = my_memalign((size_t) 32 << i, 100);
+			metadata_t* slop = findLeftBlk(HEAD_OF(blocks[i]));
+			fits = fits && (IS_IN_USE(slop) || (size_t) GET_SIZE(slop) >= getBlockSize(0) + sizeof(treenode_t));
+		}
+		printf("\n%d. Slop cut off the front should be big enough for the trees: %d", ++test, fits);
+		for (int i = 0; i < 3; i++) {
+			my_free(blocks[i]);
+		}
+	}
+#endif
+	my_free(guard);
+	char* big = (char*) my_memalign(8192, 5000);
+	printf("\n%d. A big block should be aligned too: %d", ++test, big != NULL && (uintptr_t) big % 8192 == 0 ? 1 : 0);
+	big[4999] = 1;
+	my_free(big);
+	printf("\n%d. An alignment that is not a power of two should be refused: %d", ++test, my_memalign(48, 100) == NULL ? 1 : 0);
+	printf("\n%d. Refusing an alignment should set error code to SINGLE_REQUEST_TOO_LARGE: %d", ++test, ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
+	/* A call that works clears ERRNO, so the next refusal has to set it again. */
+	my_free(my_malloc(1));
+	printf("\n%d. my_aligned_alloc should refuse a size that is not a multiple of the alignment: %d", ++test, my_aligned_alloc(64, 100) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
+	printf("\n%d. my_aligned_alloc should refuse an alignment of 0: %d", ++test, my_aligned_alloc(0, 64) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
+	void* line = my_aligned_alloc(64, 128);
+	printf("\n%d. my_aligned_alloc should give an aligned block: %d", ++test, line != NULL && (uintptr_t) line % 64 == 0 ? 1 : 0);
+	my_free(line);
+	printf("\n");
+}
+
+void test_batch(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for allocating and freeing many blocks at once. */
+	printf("\n");
+	void* guard = my_malloc(1);
+	short freelistSize = getFreelistSize();
+	void* blocks[50];
+	printf("\n%d. A batch should get every block asked for: %d", ++test, my_malloc_batch(40, 50, blocks) == 50 ? 1 : 0);
+	int together = 0;
+	for (int i = 0; i < 49; i++) {
+		memset(blocks[i], i, 40);
+		together += (char*) blocks[i + 1] == (char*) blocks[i] + getBlockSize(40);
+	}
+	printf("\n%d. The blocks should be cut from one free block: %d", ++test, together == 49 ? 1 : 0);
+	/* Freed out of order, with a hole in the middle and a NULL. */
+	metadata_t* left = HEAD_OF(blocks[0]);
+	metadata_t* right = HEAD_OF(blocks[26]);
+	void* hole = blocks[25];
+	blocks[25] = NULL;
+	for (int i = 0; i < 25; i++) {
+		void* temp = blocks[i];
+		blocks[i] = blocks[49 - i];
+		blocks[49 - i] = temp;
+	}
+	my_free_batch(blocks, 50);
+	size_t run = 24 * getBlockSize(40);
+	printf("\n%d. A batch free should merge the runs on either side of a block still in use: %d", ++test, !IS_IN_USE(left) && (size_t) GET_SIZE(left) >= run && !IS_IN_USE(right) && (size_t) GET_SIZE(right) >= run ? 1 : 0);
+	my_free(hole);
+	printf("\n%d. Freeing that block should leave the freelist as it was: %d", ++test, getFreelistSize() == freelistSize ? 1 : 0);
+	void* mixed[3] = { my_malloc(100), my_malloc(1 << 16), my_malloc(100) };
+	my_free_batch(mixed, 3);
+	printf("\n%d. A batch free should take mapped blocks too: %d", ++test, getFreelistSize() == freelistSize ? 1 : 0);
+	my_free(guard);
+	printf("\n");
+}
+
+void test_heaps(enum ORDER order) {
+	int test = 0;
+
+	/* Tests for heaps of their own, over a region or a mapping. */
+	printf("\n");
+	static char region[32 * 1024];
+	printf("\n%d. A region too small for a chunk should get no heap: %d", ++test, my_heap_create(region, 256, order) == NULL ? 1 : 0);
+	my_heap_t* heap = my_heap_create(region, sizeof(region), order);
+	char* brk = (char*) my_sbrk(0);
+	void* blocks[512];
+	int count = 0;
+	int inside = 1;
+	while (count < 512 && (blocks[count] = my_heap_malloc(heap, 100)) != NULL) {
+		inside = inside && (char*) blocks[count] >= region && (char*) blocks[count] + 100 <= region + sizeof(region);
+		((unsigned char*) blocks[count])[99] = (unsigned char) count;
+		count++;
+	}
+	printf("\n%d. Blocks should come out of the region until it is used up: %d", ++test, heap != NULL && count > 100 && inside && ERRNO == OUT_OF_MEMORY ? 1 : 0);
+	printf("\n%d. The shared heap should not grow for a heap of its own: %d", ++test, (char*) my_sbrk(0) == brk ? 1 : 0);
+	my_heap_t* mapped = my_heap_create(NULL, 64 * 1024, order);
+	char* other = (char*) my_heap_malloc(mapped, 100);
+	printf("\n%d. A mapped heap should hand out memory outside the other heap's region: %d", ++test, other != NULL && (other < region || other >= region + sizeof(region)) ? 1 : 0);
+	int intact = 1;
+	for (int i = 0; i < count; i++) {
+		intact = intact && ((unsigned char*) blocks[i])[99] == (unsigned char) i;
+		my_heap_free(heap, blocks[i]);
+	}
+	printf("\n%d. Blocks should keep their data while another heap is in use: %d", ++test, intact);
+	int again = 0;
+	while (again < count && (blocks[again] = my_heap_malloc(heap, 100)) != NULL) {
+		again++;
+	}
+	printf("\n%d. Freed blocks should be reused after the region ran out: %d", ++test, again == count ? 1 : 0);
+	my_heap_destroy(mapped);
+	my_heap_destroy(heap);
+	heap = my_heap_create(region, sizeof(region), order);
+	printf("\n%d. A region should take a new heap once the old one is destroyed: %d", ++test, my_heap_malloc(heap, 100) != NULL ? 1 : 0);
+	my_heap_destroy(heap);
+	printf("\n");
+}
+
+void test_region() {
+	int test = 0;
+
+	/* Tests for bump allocation out of a region. */
+	printf("\n");
+	my_region_t* region = my_region_create();
+	char* a = (char*) my_region_alloc(region, 10);
+	char* b = (char*) my_region_alloc(region, 10);
+	printf("\n%d. Region memory should be aligned and handed out in order: %d", ++test, region != NULL && a != NULL && (uintptr_t) a % 16 == 0 && b >= a + 10 ? 1 : 0);
+	char* big = (char*) my_region_alloc(region, 3000);
+	if (big != NULL) {
+		for (int i = 0; i < 3000; i++) {
+			big[i] = (char) i;
+		}
+	}
+	printf("\n%d. A request bigger than a chunk should get a chunk of its own: %d", ++test, big != NULL && ERRNO == NO_ERROR ? 1 : 0);
+	printf("\n%d. Too large a request should set SINGLE_REQUEST_TOO_LARGE: %d", ++test, my_region_alloc(region, (size_t) -1) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE ? 1 : 0);
+	my_region_reset(region);
+	printf("\n%d. A reset region should start over at its first chunk: %d", ++test, my_region_alloc(region, 10) == a ? 1 : 0);
+	my_region_destroy(region);
+	void* after = my_malloc_size_order(3000);
+	printf("\n%d. Destroying a region should give its chunks back to the heap: %d", ++test, after != NULL ? 1 : 0);
+	my_free_size_order(after);
+	printf("\n");
+}
+
+/* Times a request's worth of small allocations that are all freed
+together at the end, once with malloc and free and once with a region. */
+void time_region(malloc_func_type my_malloc, free_func_type my_free) {
+	const int ROUNDS = 20000;
+	void* blocks[64];
+	clock_t start_time = clock();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < 64; i++) {
+			blocks[i] = my_malloc(16 + i % 48);
+		}
+		for (int i = 0; i < 64; i++) {
+			my_free(blocks[i]);
+		}
+	}
+	clock_t post_free_time = clock();
+	my_region_t* region = my_region_create();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < 64; i++) {
+			blocks[i] = my_region_alloc(region, 16 + i % 48);
+		}
+		my_region_reset(region);
+	}
+	clock_t post_region_time = clock();
+	my_region_destroy(region);
+	printf("Time to run %d rounds of 64 allocations in milliseconds:\n", ROUNDS);
+	printf("malloc and free: %lu\n", (long unsigned int) (post_free_time - start_time) * 1000 / CLOCKS_PER_SEC);
+	printf("region and reset: %lu\n", (long unsigned int) (post_region_time - post_free_time) * 1000 / CLOCKS_PER_SEC);
+}
+
+/* Tests for the reserved heap backend. It has to be picked before the
+first call to my_sbrk, so these run in a process of their own forked
+before main touches the heap. */
+void test_reserved_heap() {
+	int test = 0;
+	printf("\n");
+	fflush(stdout);
+	if (fork() == 0) {
+		printf("\n%d. Reserved backend should be accepted before the heap is used: %d", ++test, my_sbrk_init(SBRK_RESERVED, (size_t) 1 << 30));
+		/* Tests for how much the heap grows by at a time, on a heap that
+		has nothing free yet. */
+		void* grown[20];
+		char* base = (char*) my_sbrk(0);
+		my_mallopt(GROW_CHUNK, 8000);
+		grown[0] = my_malloc_size_order(100);
+		char* brk = (char*) my_sbrk(0);
+		printf("\n%d. Heap should grow by GROW_CHUNK rounded up to SBRK_SIZE: %d", ++test, brk - base == 8192 ? 1 : 0);
+		my_mallopt(GROW_POLICY, GROW_GEOMETRIC);
+		int n = 1;
+		while ((char*) my_sbrk(0) == brk && n < 20) {
+			grown[n++] = my_malloc_size_order(1000);
+		}
+		printf("\n%d. Geometric growth should at least double the heap: %d", ++test, (char*) my_sbrk(0) - brk >= brk - base ? 1 : 0);
+		for (int i = 0; i < n; i++) {
+			my_free_size_order(grown[i]);
+		}
+		my_mallopt(GROW_POLICY, GROW_FIXED);
+		int* blocks[1000];
+		int allThere = 1;
+		for (int i = 0; i < 1000; i++) {
+			blocks[i] = (int*) my_malloc_size_order(1000);
+			if (blocks[i] == NULL) {
+				allThere = 0;
+				break;
+			}
+			blocks[i][0] = i;
+			blocks[i][249] = i;
+		}
+		printf("\n%d. Heap should grow to hold 1000 KB: %d", ++test, allThere);
+		int intact = allThere;
+		for (int i = 0; allThere && i < 1000; i++) {
+			intact = intact && blocks[i][0] == i && blocks[i][249] == i;
+			my_free_size_order(blocks[i]);
+		}
+		printf("\n%d. All of it should keep its data: %d", ++test, intact);
+		printf("\n%d. Unknown growth policy should be refused: %d", ++test, my_mallopt(GROW_POLICY, 7) == 0 ? 1 : 0);
+		printf("\n%d. Backend should not change once the heap is in use: %d", ++test, my_sbrk_init(SBRK_EMULATED, 0) == 0 ? 1 : 0);
+		printf("\n");
+		exit(0);
+	}
+	wait(NULL);
+}
+
+/* Tests for the huge page heap backend, which also has to be picked
+before the first call to my_sbrk. Whether the kernel really gives it huge
+pages is up to the kernel, so only what it promises either way is
+checked. */
+void test_huge_heap() {
+	int test = 0;
+	size_t huge = (size_t) 2 << 20;
+	printf("\n");
+	fflush(stdout);
+	if (fork() == 0) {
+		printf("\n%d. Huge page backend should be accepted before the heap is used: %d", ++test, my_sbrk_init(SBRK_HUGE, (size_t) 1 << 30));
+		char* base = (char*) my_sbrk(0);
+		printf("\n%d. Heap should start on a huge page boundary: %d", ++test, base != NULL && (uintptr_t) base % huge == 0 ? 1 : 0);
+		/* 5000 KB of blocks spans three huge pages. */
+		int* blocks[5000];
+		int allThere = 1;
+		for (int i = 0; i < 5000; i++) {
+			blocks[i] = (int*) my_malloc_size_order(1000);
+			if (blocks[i] == NULL) {
+				allThere = 0;
+				break;
+			}
+			blocks[i][0] = i;
+			blocks[i][249] = i;
+		}
+		printf("\n%d. Heap should grow to hold 5000 KB: %d", ++test, allThere);
+		char* grown = (char*) my_sbrk(0);
+		int intact = allThere;
+		for (int i = 1; allThere && i < 5000; i++) {
+			intact = intact && blocks[i][0] == i && blocks[i][249] == i;
+			my_free_size_order(blocks[i]);
+		}
+		printf("\n%d. All of it should keep its data: %d", ++test, intact);
+		my_malloc_trim(0);
+		char* brk = (char*) my_sbrk(0);
+		printf("\n%d. Trimming should move the break down: %d", ++test, brk > base && brk < grown ? 1 : 0);
+		printf("\n%d. The block left in it should keep its data: %d", ++test, blocks[0][0] == 0 && blocks[0][249] == 0 ? 1 : 0);
+		/* The heap grows back over pages that were given back. */
+		for (int i = 1; allThere && i < 5000; i++) {
+			blocks[i] = (int*) my_malloc_size_order(1000);
+			allThere = blocks[i] != NULL;
+			if (allThere) {
+				blocks[i][249] = i;
+			}
+		}
+		intact = allThere;
+		for (int i = 1; allThere && i < 5000; i++) {
+			intact = intact && blocks[i][249] == i;
+			my_free_size_order(blocks[i]);
+		}
+		printf("\n%d. Heap should grow again after trimming: %d", ++test, intact);
+		my_free_size_order(blocks[0]);
+		printf("\n");
+		exit(0);
+	}
+	wait(NULL);
+}
+
+#ifdef THREAD_SAFE
+struct thread_args {
+	malloc_func_type my_malloc;
+	free_func_type my_free;
+	unsigned int seed;
+	int intact;
+	int arena;
+};
+
+/* Keeps a handful of small blocks alive at a time, checking each one
+still holds what was written to it before it is freed. */
+void* thread_churn(void* arg) {
+	struct thread_args* args = (struct thread_args*) arg;
+	unsigned char* blocks[8] = {NULL};
+	size_t sizes[8];
+	args->intact = 1;
+	args->arena = -1;
+	for (int i = 0; i < 2000; i++) {
+		int slot = rand_r(&args->seed) % 8;
+		if (blocks[slot] != NULL) {
+			for (size_t j = 0; j < sizes[slot]; j++) {
+				args->intact = args->intact && blocks[slot][j] == (unsigned char) (slot + sizes[slot]);
+			}
+			args->my_free(blocks[slot]);
+			blocks[slot] = NULL;
+		} else {
+			sizes[slot] = 1 + rand_r(&args->seed) % 64;
+			blocks[slot] = (unsigned char*) args->my_malloc(sizes[slot]);
+			if (blocks[slot] == NULL) {
+				args->intact = 0;
+				continue;
+			}
+			if (args->arena < 0) {
+				args->arena = my_sbrk_owner(blocks[slot]);
+			}
+			for (size_t j = 0; j < sizes[slot]; j++) {
+				blocks[slot][j] = (unsigned char) (slot + sizes[slot]);
+			}
+		}
+	}
+	for (int slot = 0; slot < 8; slot++) {
+		args->my_free(blocks[slot]);
+	}
+	return NULL;
+}
+
+void* thread_too_large(void* arg) {
+	struct thread_args* args = (struct thread_args*) arg;
+	args->intact = args->my_malloc((size_t) -1) == NULL && ERRNO == SINGLE_REQUEST_TOO_LARGE;
+	return NULL;
+}
+
+/* A ring of blocks one thread allocates and another frees. Only the
+producer writes allocated and only the consumer writes intact, so the
+two threads never write the same result. */
+struct handoff {
+	malloc_func_type my_malloc;
+	free_func_type my_free;
+	void* slots[16];
+	unsigned int put;
+	unsigned int taken;
+	int allocated;
+	int intact;
+};
+
+void* thread_produce(void* arg) {
+	struct handoff* ring = (struct handoff*) arg;
+	for (unsigned int i = 0; i < 2000; i++) {
+		unsigned char* blk = (unsigned char*) ring->my_malloc(1 + i % 64);
+		if (blk == NULL) {
+			ring->allocated = 0;
+		} else {
+			blk[0] = (unsigned char) i;
+		}
+		while (i - __atomic_load_n(&ring->taken, __ATOMIC_ACQUIRE) >= 16) {
+			sched_yield();
+		}
+		ring->slots[i % 16] = blk;
+		__atomic_store_n(&ring->put, i + 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+void* thread_consume(void* arg) {
+	struct handoff* ring = (struct handoff*) arg;
+	for (unsigned int i = 0; i < 2000; i++) {
+		while (__atomic_load_n(&ring->put, __ATOMIC_ACQUIRE) == i) {
+			sched_yield();
+		}
+		unsigned char* blk = (unsigned char*) ring->slots[i % 16];
+		if (blk != NULL) {
+			ring->intact = ring->intact && blk[0] == (unsigned char) i;
+			ring->my_free(blk);
+		}
+		__atomic_store_n(&ring->taken, i + 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+void test_threads(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for calling the allocator from several threads at once. */
+	printf("\n");
+	printf("\n%d. Arena count outside 1 to MAX_ARENAS should be refused: %d", ++test, my_mallopt(ARENA_COUNT, 0) == 0 && my_mallopt(ARENA_COUNT, MAX_ARENAS + 1) == 0 ? 1 : 0);
+	/* Threads are handed arenas round-robin, so four new threads over four
+	arenas never all share one, whatever the number of cores. */
+	my_mallopt(ARENA_COUNT, 4);
+	pthread_t threads[4];
+	struct thread_args args[4];
+	for (int i = 0; i < 4; i++) {
+		args[i].my_malloc = my_malloc;
+		args[i].my_free = my_free;
+		args[i].seed = i + 1;
+		pthread_create(&threads[i], NULL, thread_churn, &args[i]);
+	}
+	int intact = 1;
+	int spread = 0;
+	for (int i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+		intact = intact && args[i].intact;
+		spread = spread || args[i].arena != args[0].arena;
+	}
+	printf("\n%d. Blocks from threads allocating at once should keep their data: %d", ++test, intact);
+	printf("\n%d. Threads should be spread over more than one arena: %d", ++test, spread);
+	my_free(my_malloc(10));
+	pthread_create(&threads[0], NULL, thread_too_large, &args[0]);
+	pthread_join(threads[0], NULL);
+	printf("\n%d. ERRNO should be set for the thread that failed only: %d", ++test, args[0].intact && ERRNO == NO_ERROR ? 1 : 0);
+	/* Far more than the heap holds goes from one thread to the other, so
+	this only works if frees from the other thread are reused. */
+	struct handoff ring = { my_malloc, my_free, {NULL}, 0, 0, 1, 1 };
+	pthread_create(&threads[0], NULL, thread_produce, &ring);
+	pthread_create(&threads[1], NULL, thread_consume, &ring);
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+	printf("\n%d. Blocks freed by another thread than the one that allocated them should be reused: %d", ++test, ring.allocated && ring.intact ? 1 : 0);
+	printf("\n");
+}
+#endif
+
+#ifdef THREAD_CACHE
+void test_tcache(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for the per-thread cache of freed blocks. */
+	printf("\n");
+	printf("\n%d. TCACHE_COUNT should be taken: %d", ++test, my_mallopt(TCACHE_COUNT, 4));
+	void* first = my_malloc(40);
+	short freelistSize = getFreelistSize();
+	my_free(first);
+	printf("\n%d. A small free should stay in the thread's cache: %d", ++test, getFreelistSize() == freelistSize ? 1 : 0);
+	printf("\n%d. The same size should come straight back from the cache: %d", ++test, my_malloc(40) == first ? 1 : 0);
+	my_free(first);
+	void* blocks[5];
+	for (int i = 0; i < 5; i++) {
+		blocks[i] = my_malloc(40);
+	}
+	for (int i = 0; i < 5; i++) {
+		my_free(blocks[i]);
+	}
+	printf("\n%d. A full cache should give half of itself back to the heap: %d", ++test, getFreelistSize() != freelistSize ? 1 : 0);
+	printf("\n");
+}
+#endif
+
+void test_fastbins(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for putting off coalescing of small frees. */
+	printf("\n");
+	printf("\n%d. FASTBIN_MAX over 160 should be refused: %d", ++test, my_mallopt(FASTBIN_MAX, 161) == 0 ? 1 : 0);
+	printf("\n%d. FASTBIN_MAX should be taken: %d", ++test, my_mallopt(FASTBIN_MAX, 128));
+	void* p1 = my_malloc(100);
+	void* p2 = my_malloc(100);
+	void* guard = my_malloc(100);
+	my_free(p1);
+	printf("\n%d. A small free should be reused as it is: %d", ++test, my_malloc(100) == p1 ? 1 : 0);
+	my_free(p1);
+	my_free(p2);
+	my_free(guard);
+	void* other = my_malloc(60);
+	printf("\n%d. A small request with nothing on its list should not merge the lists: %d", ++test, other != p1 && other != p2 && other != guard ? 1 : 0);
+	/* The three blocks came out next to each other, in whatever order. A
+	bigger request uses up the rest of the heap before they are merged,
+	and only then does the heap grow. */
+	char* first = (char*) p1;
+	first = (char*) p2 < first ? (char*) p2 : first;
+	first = (char*) guard < first ? (char*) guard : first;
+	static void* big[4096];
+	int n = 0;
+	big[n] = my_malloc(150);
+	printf("\n%d. A bigger request should leave the lists alone while the heap has room: %d", ++test, big[n] != first ? 1 : 0);
+	while (n < 4095 && big[n] != NULL && big[n] != first) {
+		big[++n] = my_malloc(150);
+	}
+	printf("\n%d. Once nothing free fits, the lists should be merged and what they free up used: %d", ++test, big[n] == first ? 1 : 0);
+	for (int i = 0; i <= n; i++) {
+		my_free(big[i]);
+	}
+	/* The merge above emptied the lists, so with them off again nothing is
+	left on them for the tests that follow. */
+	my_mallopt(FASTBIN_MAX, 0);
+	my_free(other);
+	printf("\n");
+}
+
+#ifdef SLAB
+void test_slab(malloc_func_type my_malloc, free_func_type my_free) {
+	int test = 0;
+
+	/* Tests for small requests served from slabs. */
+	printf("\n");
+	printf("\n%d. SLAB_THRESHOLD over 256 should be refused: %d", ++test, my_mallopt(SLAB_THRESHOLD, 257) == 0 ? 1 : 0);
+	printf("\n%d. SLAB_THRESHOLD should be taken: %d", ++test, my_mallopt(SLAB_THRESHOLD, 256));
+	char* a = (char*) my_malloc(1);
+	char* b = (char*) my_malloc(1);
+	printf("\n%d. Tiny objects should sit next to each other with no header: %d", ++test, b == a + 8 || a == b + 8 ? 1 : 0);
+	my_free(a);
+	printf("\n%d. A freed slot should be handed out again: %d", ++test, my_malloc(1) == a ? 1 : 0);
+	my_free(a);
+	my_free(b);
+	/* 2000 ints with a header each would not fit in the 8 KB heap. */
+	int* ints[2000];
+	int all = 1;
+	for (int i = 0; i < 2000; i++) {
+		ints[i] = (int*) my_malloc(sizeof(int));
+		all = all && ints[i] != NULL;
+		if (ints[i] != NULL) {
+			*ints[i] = i;
+		}
+	}
+	int intact = all;
+	for (int i = 0; i < 2000; i++) {
+		intact = intact && *ints[i] == i;
+		my_free(ints[i]);
+	}
+	printf("\n%d. More small objects than the heap could hold with headers should fit: %d", ++test, all);
+	printf("\n%d. Slots should keep their data: %d", ++test, intact);
+	void* big = my_malloc(300);
+	printf("\n%d. A request over the threshold should still come from the heap: %d", ++test, big != NULL ? 1 : 0);
+	my_free(big);
+	my_mallopt(SLAB_THRESHOLD, 0);
+	printf("\n");
+}
+#endif
+
 int main() {
+#ifdef THREAD_CACHE
+    /* the cache would hide frees from tests that look at the freelist */
+    my_mallopt(TCACHE_COUNT, 0);
+#endif
+#ifdef SLAB
+    /* and so would slabs, for the many tests that allocate small blocks */
+    my_mallopt(SLAB_THRESHOLD, 0);
+#endif
+    /* these have to come before anything else touches the heap */
+    test_reserved_heap();
+    test_huge_heap();
+
     /* you can change this number to modify how many times the function will be run */
     const long unsigned int NUM_RUNS = 1;
     clock_t start_time = clock();
@@ -287,12 +1205,97 @@ int main() {
         test(my_malloc_addr_order, my_free_addr_order);
 
     clock_t post_addr_time = clock();
+#ifdef BOUNDARY_TAGS
+    for (long unsigned int i = 0; i < NUM_RUNS; i++)
+        test(my_malloc_segregated, my_free_segregated);
+#endif
+
+    clock_t post_seg_time = clock();
+#ifdef BOUNDARY_TAGS
+    for (long unsigned int i = 0; i < NUM_RUNS; i++)
+        test(my_malloc_tlsf, my_free_tlsf);
+#endif
+
+    clock_t post_tlsf_time = clock();
+    for (long unsigned int i = 0; i < NUM_RUNS; i++)
+        test(my_malloc_next_fit, my_free_next_fit);
+
+    clock_t post_next_time = clock();
+    for (long unsigned int i = 0; i < NUM_RUNS; i++)
+        test(my_malloc_good_fit, my_free_good_fit);
+
+    clock_t post_good_time = clock();
     long unsigned int milli_seconds_size = (post_size_time - start_time) * 1000 / CLOCKS_PER_SEC;
     long unsigned int milli_seconds_addr = (post_addr_time - post_size_time) * 1000 / CLOCKS_PER_SEC;
+    long unsigned int milli_seconds_seg = (post_seg_time - post_addr_time) * 1000 / CLOCKS_PER_SEC;
+    long unsigned int milli_seconds_tlsf = (post_tlsf_time - post_seg_time) * 1000 / CLOCKS_PER_SEC;
+    long unsigned int milli_seconds_next = (post_next_time - post_tlsf_time) * 1000 / CLOCKS_PER_SEC;
+    long unsigned int milli_seconds_good = (post_good_time - post_next_time) * 1000 / CLOCKS_PER_SEC;
 
     printf("Time to run %lu iterations in milliseconds:\n", NUM_RUNS);
     printf("sorted by size test: %lu\n", milli_seconds_size);
     printf("sorted by addr test: %lu\n", milli_seconds_addr);
+#ifdef BOUNDARY_TAGS
+    printf("segregated bins test: %lu\n", milli_seconds_seg);
+    printf("tlsf bins test: %lu\n", milli_seconds_tlsf);
+#endif
+    printf("next fit test: %lu\n", milli_seconds_next);
+    printf("good fit test: %lu\n", milli_seconds_good);
+
+    time_region(my_malloc_size_order, my_free_size_order);
+
+    test_best_fit();
+    test_trim(my_malloc_size_order, my_free_size_order);
+    test_region();
+    test_fits();
+    test_realloc(my_malloc_size_order, my_free_size_order);
+    test_realloc(my_malloc_addr_order, my_free_addr_order);
+    test_calloc(my_malloc_size_order, my_free_size_order);
+    test_calloc(my_malloc_addr_order, my_free_addr_order);
+    test_memalign(my_malloc_size_order, my_free_size_order);
+    test_memalign(my_malloc_addr_order, my_free_addr_order);
+    test_batch(my_malloc_size_order, my_free_size_order);
+    test_batch(my_malloc_addr_order, my_free_addr_order);
+    test_heaps(SIZE);
+    test_heaps(ADDRESS);
+    test_heaps(NEXT_FIT);
+    test_heaps(GOOD_FIT);
+    test_index(SIZE);
+    test_index(ADDRESS);
+#ifdef BOUNDARY_TAGS
+    test_heaps(SEGREGATED);
+    test_heaps(TLSF);
+    test_bins(my_malloc_segregated, my_free_segregated);
+    test_bins(my_malloc_tlsf, my_free_tlsf);
+    test_trim(my_malloc_segregated, my_free_segregated);
+    test_realloc(my_malloc_tlsf, my_free_tlsf);
+    test_calloc(my_malloc_tlsf, my_free_tlsf);
+    test_memalign(my_malloc_tlsf, my_free_tlsf);
+    test_batch(my_malloc_tlsf, my_free_tlsf);
+#endif
+    test_fastbins(my_malloc_size_order, my_free_size_order);
+#ifdef BOUNDARY_TAGS
+    test_fastbins(my_malloc_tlsf, my_free_tlsf);
+#endif
+#ifdef SLAB
+    test_slab(my_malloc_size_order, my_free_size_order);
+#ifdef BOUNDARY_TAGS
+    test_slab(my_malloc_tlsf, my_free_tlsf);
+#endif
+#endif
+#ifdef THREAD_CACHE
+    test_tcache(my_malloc_size_order, my_free_size_order);
+#endif
+#ifdef THREAD_SAFE
+    test_threads(my_malloc_size_order, my_free_size_order);
+#ifdef BOUNDARY_TAGS
+    test_threads(my_malloc_tlsf, my_free_tlsf);
+#endif
+#endif
+#ifndef BOUNDARY_TAGS
+    (void) milli_seconds_seg;
+    (void) milli_seconds_tlsf;
+#endif
 
 	return 0;
 }